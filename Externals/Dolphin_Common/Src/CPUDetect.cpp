@@ -27,6 +27,7 @@
 #undef _interlockedbittestandreset
 #undef _interlockedbittestandset64
 #undef _interlockedbittestandreset64
+#include <immintrin.h> // _xgetbv
 #else
 
 //#include <config/i386/cpuid.h>
@@ -51,7 +52,8 @@ static inline void do_cpuid(unsigned int *eax, unsigned int *ebx,
 		  "=g" (*ebx),
 		  "=c" (*ecx),
 		  "=d" (*edx)
-		: "a"  (*eax)
+		: "a"  (*eax),
+		  "c"  (*ecx)
 		: "rdi", "rbx"
 		);
 #else
@@ -64,19 +66,20 @@ static inline void do_cpuid(unsigned int *eax, unsigned int *ebx,
 		  "=g" (*ebx),
 		  "=c" (*ecx),
 		  "=d" (*edx)
-		: "a"  (*eax)
+		: "a"  (*eax),
+		  "c"  (*ecx)
 		: "edi", "ebx"
 		);
 #endif
 }
 #endif /* defined __FreeBSD__ */
 
-static void __cpuid(int info[4], int x)
+static void __cpuidex(int info[4], int x, int subleaf)
 {
 #if defined __FreeBSD__
-    do_cpuid((unsigned int)x, (unsigned int*)info);
+    cpuid_count((unsigned int)x, (unsigned int)subleaf, (unsigned int*)info);
 #else
-	unsigned int eax = x, ebx = 0, ecx = 0, edx = 0;
+	unsigned int eax = x, ebx = 0, ecx = subleaf, edx = 0;
 	do_cpuid(&eax, &ebx, &ecx, &edx);
 	info[0] = eax;
 	info[1] = ebx;
@@ -85,6 +88,18 @@ static void __cpuid(int info[4], int x)
 #endif
 }
 
+static void __cpuid(int info[4], int x)
+{
+	__cpuidex(info, x, 0);
+}
+
+static unsigned long long _xgetbv(unsigned int index)
+{
+	unsigned int eax, edx;
+	__asm__ __volatile__("xgetbv" : "=a" (eax), "=d" (edx) : "c" (index));
+	return ((unsigned long long)edx << 32) | eax;
+}
+
 #endif
 
 #include "Common.h"
@@ -162,8 +177,17 @@ void CPUInfo::Detect()
 		if ((cpu_id[2] >> 9)  & 1) bSSSE3 = true;
 		if ((cpu_id[2] >> 19) & 1) bSSE4_1 = true;
 		if ((cpu_id[2] >> 20) & 1) bSSE4_2 = true;
-		if ((cpu_id[2] >> 28) & 1) bAVX = true;
 		if ((cpu_id[2] >> 25) & 1) bAES = true;
+		// AVX also needs the OS to save the ymm registers (OSXSAVE, XCR0 bits 1 and 2)
+		if (((cpu_id[2] >> 28) & 1) && ((cpu_id[2] >> 27) & 1))
+		{
+			if ((_xgetbv(0) & 6) == 6)
+				bAVX = true;
+		}
+	}
+	if (max_std_fn >= 7) {
+		__cpuidex(cpu_id, 0x00000007, 0);
+		if (((cpu_id[1] >> 5) & 1) && bAVX) bAVX2 = true;
 	}
 	if (max_ex_fn >= 0x80000004) {
 		// Extract brand string
@@ -227,6 +251,7 @@ std::string CPUInfo::Summarize()
 	if (bSSE4_2) sum += ", SSE4.2";
 	if (HTT) sum += ", HTT";
 	if (bAVX) sum += ", AVX";
+	if (bAVX2) sum += ", AVX2";
 	if (bAES) sum += ", AES";
 	if (bLongMode) sum += ", 64-bit support";
 	return sum;
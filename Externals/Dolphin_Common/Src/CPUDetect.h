@@ -52,6 +52,7 @@ struct CPUInfo
 	bool bLZCNT;
 	bool bSSE4A;
 	bool bAVX;
+	bool bAVX2;
 	bool bAES;
 	bool bLAHFSAHF64;
 	bool bLongMode;
@@ -17,6 +17,22 @@
 
 #include "Common.h"
 #include "ColorUtil.h"
+#include "CPUDetect.h"
+
+// SSE2 is always there on x86 (the build passes -msse2), the SSSE3 and AVX2
+// versions are only used when cpu_info reports them. Without -mssse3 gcc
+// gets pshufb from CommonFuncs.h.
+#if defined(_M_X64) || defined(_M_IX86)
+#include <emmintrin.h>
+#define COLORUTIL_SSE2
+#if !(defined __GNUC__ && !defined __SSSE3__)
+#include <tmmintrin.h>
+#endif
+// keep in sync with ColorUtilAVX2.cpp
+#if (defined(_MSC_VER) && _MSC_VER >= 1700) || defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+#define COLORUTIL_AVX2
+#endif
+#endif
 
 namespace ColorUtil
 {
@@ -53,4 +69,202 @@ u32 Decode5A3(u16 val)
 	return (a << 24) | (r << 16) | (g << 8) | b;
 }
 
+static void decode5A3image_Scalar(u32* dst, const u16* src, int width, int height)
+{
+	for (int y = 0; y < height; y += 4)
+	{
+		for (int x = 0; x < width; x += 4)
+		{
+			for (int iy = 0; iy < 4; iy++, src += 4)
+			{
+				for (int ix = 0; ix < 4; ix++)
+				{
+					u32 RGBA = Decode5A3(Common::swap16(src[ix]));
+					dst[(y + iy) * width + (x + ix)] = RGBA;
+				}
+			}
+		}
+	}
+}
+
+static void decodePalette_Scalar(u32* dst, const u16* pal)
+{
+	for (int i = 0; i < 256; i++)
+	{
+		// huh, this seems wrong. CI8, not 5A3, no?
+		dst[i] = Decode5A3(Common::swap16(pal[i]));
+	}
+}
+#ifdef COLORUTIL_SSE2
+
+// Decode5A3 for 8 byte swapped pixels at once. The lookup tables are
+// x * 255 / 31 and x * 255 / 7 rounded down, done as a multiply and a shift,
+// and the blend over the white background divides by 255 with
+// mulhi(x, 0x8081) >> 7. All of them are exact for their whole input range,
+// so the results match Decode5A3 bit for bit. lo gets pixels 0-3, hi 4-7.
+static inline void Decode5A3_SSE2(__m128i val, __m128i &lo, __m128i &hi)
+{
+	const __m128i mask5 = _mm_set1_epi16(0x1F);
+	const __m128i mask4 = _mm_set1_epi16(0x0F);
+	const __m128i mask3 = _mm_set1_epi16(0x07);
+	const __m128i div255 = _mm_set1_epi16((short)0x8081);
+
+	// RGB555
+	__m128i r = _mm_and_si128(_mm_srli_epi16(val, 10), mask5);
+	__m128i g = _mm_and_si128(_mm_srli_epi16(val, 5), mask5);
+	__m128i b = _mm_and_si128(val, mask5);
+	r = _mm_srli_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(1053)), 7);	// lut5to8
+	g = _mm_srli_epi16(_mm_mullo_epi16(g, _mm_set1_epi16(1053)), 7);
+	b = _mm_srli_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(1053)), 7);
+
+	// RGB4A3 blended over the background
+	__m128i a = _mm_and_si128(_mm_srli_epi16(val, 12), mask3);
+	a = _mm_srli_epi16(_mm_mullo_epi16(a, _mm_set1_epi16(583)), 4);	// lut3to8
+	const __m128i bg = _mm_mullo_epi16(_mm_sub_epi16(_mm_set1_epi16(0xFF), a), _mm_set1_epi16(0xFF));
+	__m128i ra = _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(val, 8), mask4), _mm_set1_epi16(0x11));
+	__m128i ga = _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(val, 4), mask4), _mm_set1_epi16(0x11));
+	__m128i ba = _mm_mullo_epi16(_mm_and_si128(val, mask4), _mm_set1_epi16(0x11));
+	ra = _mm_srli_epi16(_mm_mulhi_epu16(_mm_add_epi16(_mm_mullo_epi16(ra, a), bg), div255), 7);
+	ga = _mm_srli_epi16(_mm_mulhi_epu16(_mm_add_epi16(_mm_mullo_epi16(ga, a), bg), div255), 7);
+	ba = _mm_srli_epi16(_mm_mulhi_epu16(_mm_add_epi16(_mm_mullo_epi16(ba, a), bg), div255), 7);
+
+	const __m128i opaque = _mm_srai_epi16(val, 15);
+	r = _mm_or_si128(_mm_and_si128(opaque, r), _mm_andnot_si128(opaque, ra));
+	g = _mm_or_si128(_mm_and_si128(opaque, g), _mm_andnot_si128(opaque, ga));
+	b = _mm_or_si128(_mm_and_si128(opaque, b), _mm_andnot_si128(opaque, ba));
+
+	const __m128i gb = _mm_or_si128(_mm_slli_epi16(g, 8), b);
+	const __m128i ar = _mm_or_si128(r, _mm_set1_epi16((short)0xFF00));
+	lo = _mm_unpacklo_epi16(gb, ar);
+	hi = _mm_unpackhi_epi16(gb, ar);
+}
+
+static inline __m128i Swap16_SSE2(__m128i val)
+{
+	return _mm_or_si128(_mm_slli_epi16(val, 8), _mm_srli_epi16(val, 8));
+}
+
+// a 4x4 tile is two registers, each holds two rows
+static void decode5A3image_SSE2(u32* dst, const u16* src, int width, int height)
+{
+	for (int y = 0; y < height; y += 4)
+	{
+		for (int x = 0; x < width; x += 4)
+		{
+			for (int iy = 0; iy < 4; iy += 2, src += 8)
+			{
+				__m128i lo, hi;
+				Decode5A3_SSE2(Swap16_SSE2(_mm_loadu_si128((const __m128i*)src)), lo, hi);
+				_mm_storeu_si128((__m128i*)(dst + (y + iy) * width + x), lo);
+				_mm_storeu_si128((__m128i*)(dst + (y + iy + 1) * width + x), hi);
+			}
+		}
+	}
+}
+
+static void decodePalette_SSE2(u32* dst, const u16* pal)
+{
+	for (int i = 0; i < 256; i += 8)
+	{
+		__m128i lo, hi;
+		Decode5A3_SSE2(Swap16_SSE2(_mm_loadu_si128((const __m128i*)(pal + i))), lo, hi);
+		_mm_storeu_si128((__m128i*)(dst + i), lo);
+		_mm_storeu_si128((__m128i*)(dst + i + 4), hi);
+	}
+}
+// same as SSE2, with pshufb doing the byte swap
+
+static inline __m128i Swap16_SSSE3(__m128i val)
+{
+	const __m128i mask = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+	return _mm_shuffle_epi8(val, mask);
+}
+
+static void decode5A3image_SSSE3(u32* dst, const u16* src, int width, int height)
+{
+	for (int y = 0; y < height; y += 4)
+	{
+		for (int x = 0; x < width; x += 4)
+		{
+			for (int iy = 0; iy < 4; iy += 2, src += 8)
+			{
+				__m128i lo, hi;
+				Decode5A3_SSE2(Swap16_SSSE3(_mm_loadu_si128((const __m128i*)src)), lo, hi);
+				_mm_storeu_si128((__m128i*)(dst + (y + iy) * width + x), lo);
+				_mm_storeu_si128((__m128i*)(dst + (y + iy + 1) * width + x), hi);
+			}
+		}
+	}
+}
+
+static void decodePalette_SSSE3(u32* dst, const u16* pal)
+{
+	for (int i = 0; i < 256; i += 8)
+	{
+		__m128i lo, hi;
+		Decode5A3_SSE2(Swap16_SSSE3(_mm_loadu_si128((const __m128i*)(pal + i))), lo, hi);
+		_mm_storeu_si128((__m128i*)(dst + i), lo);
+		_mm_storeu_si128((__m128i*)(dst + i + 4), hi);
+	}
+}
+#endif
+
+#ifdef COLORUTIL_AVX2
+// ColorUtilAVX2.cpp
+void decode5A3image_AVX2(u32* dst, const u16* src, int width, int height);
+void decodePalette_AVX2(u32* dst, const u16* pal);
+#endif
+
+void decode5A3image(u32* dst, const u16* src, int width, int height)
+{
+#ifdef COLORUTIL_AVX2
+	if (cpu_info.bAVX2)
+		return decode5A3image_AVX2(dst, src, width, height);
+#endif
+#ifdef COLORUTIL_SSE2
+	if (cpu_info.bSSSE3)
+		return decode5A3image_SSSE3(dst, src, width, height);
+	if (cpu_info.bSSE2)
+		return decode5A3image_SSE2(dst, src, width, height);
+#endif
+	decode5A3image_Scalar(dst, src, width, height);
+}
+
+void decodePalette(u32* dst, const u16* pal)
+{
+#ifdef COLORUTIL_AVX2
+	if (cpu_info.bAVX2)
+		return decodePalette_AVX2(dst, pal);
+#endif
+#ifdef COLORUTIL_SSE2
+	if (cpu_info.bSSSE3)
+		return decodePalette_SSSE3(dst, pal);
+	if (cpu_info.bSSE2)
+		return decodePalette_SSE2(dst, pal);
+#endif
+	decodePalette_Scalar(dst, pal);
+}
+
+void decodeCI8image(u32* dst, const u8* src, const u32* palette, int width, int height)
+{
+	for (int y = 0; y < height; y += 4)
+	{
+		for (int x = 0; x < width; x += 8)
+		{
+			for (int iy = 0; iy < 4; iy++, src += 8)
+			{
+				u32 *tdst = dst+(y+iy)*width+x;
+				for (int ix = 0; ix < 8; ix++)
+					tdst[ix] = palette[src[ix]];
+			}
+		}
+	}
+}
+
+void decodeCI8image(u32* dst, const u8* src, const u16* pal, int width, int height)
+{
+	u32 palette[256];
+	decodePalette(palette, pal);
+	decodeCI8image(dst, src, palette, width, height);
+}
 }  // namespace
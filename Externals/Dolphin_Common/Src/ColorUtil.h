@@ -23,6 +23,18 @@ namespace ColorUtil
 
 u32 Decode5A3(u16 val);
 
+// Decode a tiled big endian image to 0xAARRGGBB. width has to be a multiple
+// of 8 and height a multiple of 4. The widest SIMD version the CPU supports is
+// used, the results are identical to decoding each pixel with Decode5A3.
+void decode5A3image(u32* dst, const u16* src, int width, int height);
+void decodeCI8image(u32* dst, const u8* src, const u16* pal, int width, int height);
+
+// Decode the 256 big endian RGB5A3 entries of a CI8 palette. Images that
+// share a palette can decode it once and use the other decodeCI8image,
+// which only looks up each pixel in the decoded palette.
+void decodePalette(u32* dst, const u16* pal);
+void decodeCI8image(u32* dst, const u8* src, const u32* palette, int width, int height);
+
 }  // namespace
 
 #endif // _COLORUTIL_H_
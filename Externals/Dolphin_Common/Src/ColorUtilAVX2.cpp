@@ -0,0 +1,112 @@
+// Copyright (C) 2003 Dolphin Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official SVN repository and contact information can be found at
+// http://code.google.com/p/dolphin-emu/
+
+// AVX2 versions of the ColorUtil RGB5A3 decoders, ColorUtil.cpp picks them
+// when cpu_info.bAVX2 is set. They live here because immintrin.h clashes with
+// the pshufb from CommonFuncs.h, so this file doesn't include Common.h.
+
+#include "CommonTypes.h"
+
+// keep in sync with ColorUtil.cpp
+#if (defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)) && \
+	((defined(_MSC_VER) && _MSC_VER >= 1700) || defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace ColorUtil
+{
+
+// Decode5A3_SSE2 (ColorUtil.cpp) on 16 pixels, byte swapping them first.
+// The unpacks work on each 128 bit lane, so lo gets pixels 0-3 and 8-11,
+// hi pixels 4-7 and 12-15.
+TARGET_AVX2 static inline void Decode5A3_AVX2(__m256i val, __m256i &lo, __m256i &hi)
+{
+	const __m256i mask5 = _mm256_set1_epi16(0x1F);
+	const __m256i mask4 = _mm256_set1_epi16(0x0F);
+	const __m256i mask3 = _mm256_set1_epi16(0x07);
+	const __m256i div255 = _mm256_set1_epi16((short)0x8081);
+
+	const __m256i shuffle = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+		1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+	val = _mm256_shuffle_epi8(val, shuffle);
+
+	__m256i r = _mm256_and_si256(_mm256_srli_epi16(val, 10), mask5);
+	__m256i g = _mm256_and_si256(_mm256_srli_epi16(val, 5), mask5);
+	__m256i b = _mm256_and_si256(val, mask5);
+	r = _mm256_srli_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(1053)), 7);	// lut5to8
+	g = _mm256_srli_epi16(_mm256_mullo_epi16(g, _mm256_set1_epi16(1053)), 7);
+	b = _mm256_srli_epi16(_mm256_mullo_epi16(b, _mm256_set1_epi16(1053)), 7);
+
+	__m256i a = _mm256_and_si256(_mm256_srli_epi16(val, 12), mask3);
+	a = _mm256_srli_epi16(_mm256_mullo_epi16(a, _mm256_set1_epi16(583)), 4);	// lut3to8
+	const __m256i bg = _mm256_mullo_epi16(_mm256_sub_epi16(_mm256_set1_epi16(0xFF), a), _mm256_set1_epi16(0xFF));
+	__m256i ra = _mm256_mullo_epi16(_mm256_and_si256(_mm256_srli_epi16(val, 8), mask4), _mm256_set1_epi16(0x11));
+	__m256i ga = _mm256_mullo_epi16(_mm256_and_si256(_mm256_srli_epi16(val, 4), mask4), _mm256_set1_epi16(0x11));
+	__m256i ba = _mm256_mullo_epi16(_mm256_and_si256(val, mask4), _mm256_set1_epi16(0x11));
+	ra = _mm256_srli_epi16(_mm256_mulhi_epu16(_mm256_add_epi16(_mm256_mullo_epi16(ra, a), bg), div255), 7);
+	ga = _mm256_srli_epi16(_mm256_mulhi_epu16(_mm256_add_epi16(_mm256_mullo_epi16(ga, a), bg), div255), 7);
+	ba = _mm256_srli_epi16(_mm256_mulhi_epu16(_mm256_add_epi16(_mm256_mullo_epi16(ba, a), bg), div255), 7);
+
+	const __m256i opaque = _mm256_srai_epi16(val, 15);
+	r = _mm256_blendv_epi8(ra, r, opaque);
+	g = _mm256_blendv_epi8(ga, g, opaque);
+	b = _mm256_blendv_epi8(ba, b, opaque);
+
+	const __m256i gb = _mm256_or_si256(_mm256_slli_epi16(g, 8), b);
+	const __m256i ar = _mm256_or_si256(r, _mm256_set1_epi16((short)0xFF00));
+	lo = _mm256_unpacklo_epi16(gb, ar);
+	hi = _mm256_unpackhi_epi16(gb, ar);
+}
+
+// a whole 4x4 tile per register
+TARGET_AVX2 void decode5A3image_AVX2(u32* dst, const u16* src, int width, int height)
+{
+	for (int y = 0; y < height; y += 4)
+	{
+		for (int x = 0; x < width; x += 4, src += 16)
+		{
+			__m256i lo, hi;
+			Decode5A3_AVX2(_mm256_loadu_si256((const __m256i*)src), lo, hi);
+			u32 *tdst = dst + y * width + x;
+			_mm_storeu_si128((__m128i*)tdst, _mm256_castsi256_si128(lo));
+			_mm_storeu_si128((__m128i*)(tdst + width), _mm256_castsi256_si128(hi));
+			_mm_storeu_si128((__m128i*)(tdst + width * 2), _mm256_extracti128_si256(lo, 1));
+			_mm_storeu_si128((__m128i*)(tdst + width * 3), _mm256_extracti128_si256(hi, 1));
+		}
+	}
+}
+
+// 16 palette entries per register
+TARGET_AVX2 void decodePalette_AVX2(u32* dst, const u16* pal)
+{
+	for (int i = 0; i < 256; i += 16)
+	{
+		__m256i lo, hi;
+		Decode5A3_AVX2(_mm256_loadu_si256((const __m256i*)(pal + i)), lo, hi);
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256((__m256i*)(dst + i + 8), _mm256_permute2x128_si256(lo, hi, 0x31));
+	}
+}
+}  // namespace
+
+#endif
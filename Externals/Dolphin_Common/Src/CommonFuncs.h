@@ -80,6 +80,8 @@ inline u64 _rotr64(u64 x, unsigned int shift){
 }
 
 #else // WIN32
+#include <intrin.h>
+
 // Function Cross-Compatibility
 	#define strcasecmp _stricmp
 	#define strncasecmp _strnicmp
@@ -154,6 +156,17 @@ inline u16 swap16(const u8* _pData) {return swap16(*(const u16*)_pData);}
 inline u32 swap32(const u8* _pData) {return swap32(*(const u32*)_pData);}
 inline u64 swap64(const u8* _pData) {return swap64(*(const u64*)_pData);}
 
+// index of the lowest set bit, _data must not be 0
+#ifdef _WIN32
+inline int LeastSignificantSetBit(u32 _data)
+	{unsigned long index; _BitScanForward(&index, _data); return (int)index;}
+#elif defined __GNUC__
+inline int LeastSignificantSetBit(u32 _data) {return __builtin_ctz(_data);}
+#else
+inline int LeastSignificantSetBit(u32 _data)
+	{int index = 0; while (!(_data & 1)) {_data >>= 1; ++index;} return index;}
+#endif
+
 }  // Namespace Common
 
 #endif // _COMMONFUNCS_H_
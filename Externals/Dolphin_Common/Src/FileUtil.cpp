@@ -33,6 +33,14 @@
 #include <dirent.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#ifdef __linux__
+#include <limits.h>
+#include <sys/uio.h>
 #endif
 
 #if defined(__APPLE__)
@@ -242,8 +250,14 @@ bool Rename(const std::string &srcFilename, const std::string &destFilename)
 {
 	INFO_LOG(COMMON, "Rename: %s --> %s", 
 			srcFilename.c_str(), destFilename.c_str());
+#ifdef _WIN32
+	// rename() refuses to replace an existing file on windows
+	if (MoveFileEx(srcFilename.c_str(), destFilename.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+		return true;
+#else
 	if (rename(srcFilename.c_str(), destFilename.c_str()) == 0)
 		return true;
+#endif
 	ERROR_LOG(COMMON, "Rename: failed %s --> %s: %s", 
 			  srcFilename.c_str(), destFilename.c_str(), GetLastErrorMsg());
 	return false;
@@ -378,6 +392,39 @@ u64 GetSize(FILE *f)
 	return size;
 }
 
+// Returns the last modification time of filename in seconds, 0 on error
+u64 GetModTime(const std::string &filename)
+{
+	struct stat64 buf;
+	if (stat64(filename.c_str(), &buf) != 0)
+	{
+		ERROR_LOG(COMMON, "GetModTime: stat failed %s: %s",
+				filename.c_str(), GetLastErrorMsg());
+		return 0;
+	}
+	return buf.st_mtime;
+}
+
+bool IsSameFile(const std::string &filename1, const std::string &filename2)
+{
+#ifdef _WIN32
+	// there are no inode numbers, the full paths are compared instead
+	char path1[MAX_PATH], path2[MAX_PATH];
+	if (!Exists(filename1) || !Exists(filename2) ||
+		!GetFullPathNameA(filename1.c_str(), MAX_PATH, path1, NULL) ||
+		!GetFullPathNameA(filename2.c_str(), MAX_PATH, path2, NULL))
+	{
+		return false;
+	}
+	return !_stricmp(path1, path2);
+#else
+	struct stat64 buf1, buf2;
+	if (stat64(filename1.c_str(), &buf1) != 0 || stat64(filename2.c_str(), &buf2) != 0)
+		return false;
+	return buf1.st_dev == buf2.st_dev && buf1.st_ino == buf2.st_ino;
+#endif
+}
+
 // creates an empty file filename, returns true on success 
 bool CreateEmptyFile(const std::string &filename)
 {
@@ -787,16 +834,21 @@ std::FILE* IOFile::ReleaseHandle()
 void IOFile::SetHandle(std::FILE* file)
 {
 	Close();
-	Clear();
 	m_file = file;
+	m_good = true;
 }
 
 u64 IOFile::GetSize()
 {
-	if (IsOpen())
-		return File::GetSize(m_file);
-	else
+	// anything stdio still buffers has to be in the file first
+	if (!IsOpen() || 0 != std::fflush(m_file))
 		return 0;
+
+#ifdef _WIN32
+	return File::GetSize(_fileno(m_file));
+#else
+	return File::GetSize(fileno(m_file));
+#endif
 }
 
 bool IOFile::Seek(s64 off, int origin)
@@ -823,6 +875,90 @@ bool IOFile::Flush()
 	return m_good;
 }
 
+bool IOFile::Sync()
+{
+	if (!Flush())
+		return false;
+
+#ifdef _WIN32
+	if (0 != _commit(_fileno(m_file)))
+#else
+	if (0 != fsync(fileno(m_file)))
+#endif
+		m_good = false;
+
+	return m_good;
+}
+
+bool IOFile::TransferVector(const Buffer* buffers, size_t count, u64 offset, bool write)
+{
+	if (!IsOpen())
+	{
+		m_good = false;
+		return false;
+	}
+
+#ifdef __linux__
+	// the file descriptor is used behind stdio's back, so nothing may be
+	// left in its buffers (this also drops what it had read ahead)
+	if (!Flush())
+		return false;
+
+	std::vector<iovec> iov(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		iov[i].iov_base = buffers[i].data;
+		iov[i].iov_len = buffers[i].length;
+	}
+
+	const int fd = fileno(m_file);
+	size_t first = 0;
+	while (true)
+	{
+		while (first < count && iov[first].iov_len == 0)
+			++first;
+		if (first == count)
+			break;
+
+		const int n = (int)std::min<size_t>(count - first, IOV_MAX);
+		ssize_t done = write ? pwritev(fd, &iov[first], n, offset) : preadv(fd, &iov[first], n, offset);
+		if (done < 0 && errno == EINTR)
+			continue;
+		// 0 is the end of the file
+		if (done <= 0)
+		{
+			m_good = false;
+			break;
+		}
+
+		// the call may stop in the middle of a buffer
+		offset += done;
+		while (done > 0)
+		{
+			const size_t part = std::min<size_t>(done, iov[first].iov_len);
+			iov[first].iov_base = (char*)iov[first].iov_base + part;
+			iov[first].iov_len -= part;
+			done -= part;
+			if (iov[first].iov_len == 0)
+				++first;
+		}
+	}
+#else
+	const u64 position = Tell();
+	if (Seek(offset, SEEK_SET))
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (!(write ? WriteBytes(buffers[i].data, buffers[i].length) : ReadBytes(buffers[i].data, buffers[i].length)))
+				break;
+		}
+	}
+	Seek(position, SEEK_SET);
+#endif
+
+	return m_good;
+}
+
 bool IOFile::Resize(u64 size)
 {
 	if (!IsOpen() || 0 !=
@@ -840,4 +976,88 @@ bool IOFile::Resize(u64 size)
 	return m_good;
 }
 
+MappedFile::MappedFile()
+	: m_data(NULL), m_size(0)
+{}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(const std::string& filename)
+{
+	Close();
+
+#ifdef _WIN32
+	HANDLE hFile = CreateFile(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+		NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(hFile, &file_size) || file_size.QuadPart == 0)
+	{
+		CloseHandle(hFile);
+		return false;
+	}
+	const u64 size = file_size.QuadPart;
+
+	// PAGE_WRITECOPY + FILE_MAP_COPY gives a private, copy-on-write view
+	HANDLE hMapping = CreateFileMapping(hFile, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	CloseHandle(hFile);
+	if (!hMapping)
+		return false;
+
+	void* data = MapViewOfFile(hMapping, FILE_MAP_COPY, 0, 0, 0);
+	// the view keeps the mapping alive
+	CloseHandle(hMapping);
+	if (!data)
+	{
+		ERROR_LOG(COMMON, "MappedFile: MapViewOfFile failed %s: %s",
+				filename.c_str(), GetLastErrorMsg());
+		return false;
+	}
+#else
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	const u64 size = File::GetSize(fd);
+	if (size == 0)
+	{
+		close(fd);
+		return false;
+	}
+
+	void* data = mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	// the mapping keeps its own reference to the file
+	close(fd);
+	if (data == MAP_FAILED)
+	{
+		ERROR_LOG(COMMON, "MappedFile: mmap failed %s: %s",
+				filename.c_str(), GetLastErrorMsg());
+		return false;
+	}
+#endif
+
+	m_data = (u8*)data;
+	m_size = size;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (!IsOpen())
+		return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(m_data);
+#else
+	munmap(m_data, (size_t)m_size);
+#endif
+	m_data = NULL;
+	m_size = 0;
+}
+
 } // namespace
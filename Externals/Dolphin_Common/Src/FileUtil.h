@@ -90,6 +90,12 @@ u64 GetSize(const int fd);
 // Overloaded GetSize, accepts FILE*
 u64 GetSize(FILE *f);
 
+// Returns the last modification time of filename in seconds, 0 on error
+u64 GetModTime(const std::string &filename);
+
+// Returns true if both names lead to the same existing file
+bool IsSameFile(const std::string &filename1, const std::string &filename2);
+
 // Returns true if successful, or path already exists.
 bool CreateDir(const std::string &filename);
 
@@ -103,7 +109,8 @@ bool Delete(const std::string &filename);
 // Deletes a directory filename, returns true on success
 bool DeleteDir(const std::string &filename);
 
-// renames file srcFilename to destFilename, returns true on success 
+// renames file srcFilename to destFilename, replacing destFilename if it exists
+// returns true on success 
 bool Rename(const std::string &srcFilename, const std::string &destFilename);
 
 // copies file srcFilename to destFilename, returns true on success 
@@ -189,6 +196,26 @@ public:
 		return WriteArray(reinterpret_cast<const char*>(data), length);
 	}
 
+	// one buffer of ReadVector/WriteVector
+	struct Buffer
+	{
+		void* data;
+		size_t length;
+	};
+
+	// read or write the buffers, one after the other, from offset in the
+	// file on, with a single system call (preadv/pwritev) where there is
+	// one. The stream position stays where it was
+	bool ReadVector(const Buffer* buffers, size_t count, u64 offset)
+	{
+		return TransferVector(buffers, count, offset, false);
+	}
+
+	bool WriteVector(const Buffer* buffers, size_t count, u64 offset)
+	{
+		return TransferVector(buffers, count, offset, true);
+	}
+
 	bool IsOpen() { return NULL != m_file; }
 
 	// m_good is set to false when a read, write or other function fails
@@ -203,9 +230,12 @@ public:
 
 	bool Seek(s64 off, int origin);
 	u64 Tell();
+	// from the file's metadata, the stream position isn't touched
 	u64 GetSize();
 	bool Resize(u64 size);
 	bool Flush();
+	// flushes and waits until the OS has written the file to disk
+	bool Sync();
 
 	// clear error state
 	void Clear() { m_good = true; std::clearerr(m_file); }
@@ -213,10 +243,34 @@ public:
 private:
 	IOFile& operator=(const IOFile&) /*= delete*/;
 
+	bool TransferVector(const Buffer* buffers, size_t count, u64 offset, bool write);
+
 	std::FILE* m_file;
 	bool m_good;
 };
 
+// maps a whole file into memory with copy-on-write semantics:
+// pages are only read from disk when first touched, and writes
+// to the view stay private to the process (they never reach the file)
+class MappedFile : NonCopyable
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool Open(const std::string& filename);
+	void Close();
+
+	bool IsOpen() const { return NULL != m_data; }
+
+	u8* GetData() const { return m_data; }
+	u64 GetSize() const { return m_size; }
+
+private:
+	u8* m_data;
+	u64 m_size;
+};
+
 }  // namespace
 
 #endif
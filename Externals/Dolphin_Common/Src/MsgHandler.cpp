@@ -17,13 +17,21 @@
 
 
 #include <stdio.h> // System
+#include <map>
 
 #include "Common.h" // Local
 #include "StringUtil.h"
+#include "StdMutex.h"
+#include "StdThread.h"
 
 bool DefaultMsgHandler(const char* caption, const char* text, bool yes_no, int Style);
 static MsgAlertHandler msg_handler = DefaultMsgHandler;
 static bool AlertEnabled = true;
+static std::mutex caption_lock;
+
+// threads whose alerts are logged instead of shown
+static std::map<std::thread::id, std::vector<std::string>*> thread_logs;
+static std::mutex thread_logs_lock;
 
 std::string DefaultStringTranslator(const char* text);
 static StringTranslator str_translator = DefaultStringTranslator;
@@ -47,6 +55,15 @@ void SetEnableAlert(bool enable)
 	AlertEnabled = enable;
 }
 
+void SetThreadAlertLog(std::vector<std::string> *messages)
+{
+	std::lock_guard<std::mutex> lk(thread_logs_lock);
+	if (messages)
+		thread_logs[std::this_thread::get_id()] = messages;
+	else
+		thread_logs.erase(std::this_thread::get_id());
+}
+
 // This is the first stop for gui alerts where the log is updated and the
 // correct window is shown
 bool MsgAlert(bool yes_no, int Style, const char* format, ...)
@@ -60,6 +77,8 @@ bool MsgAlert(bool yes_no, int Style, const char* format, ...)
 	static std::string ques_caption;
 	static std::string crit_caption;
 
+	// alerts can come from several threads, the captions are only set up once
+	caption_lock.lock();
 	if (!info_caption.length())
 	{
 		info_caption = str_translator(_trans("Information"));
@@ -67,6 +86,7 @@ bool MsgAlert(bool yes_no, int Style, const char* format, ...)
 		warn_caption = str_translator(_trans("Warning"));
 		crit_caption = str_translator(_trans("Critical"));
 	}
+	caption_lock.unlock();
 
 	switch(Style)
 	{
@@ -91,6 +111,22 @@ bool MsgAlert(bool yes_no, int Style, const char* format, ...)
 
 	ERROR_LOG(MASTER_LOG, "%s: %s", caption.c_str(), buffer);
 
+	// nobody is there to answer on a thread with a log
+	std::vector<std::string> *log = NULL;
+	thread_logs_lock.lock();
+	if (!thread_logs.empty())
+	{
+		std::map<std::thread::id, std::vector<std::string>*>::const_iterator it = thread_logs.find(std::this_thread::get_id());
+		if (it != thread_logs.end())
+			log = it->second;
+	}
+	thread_logs_lock.unlock();
+	if (log)
+	{
+		log->push_back(buffer);
+		return !yes_no;
+	}
+
 	// Don't ignore questions, especially AskYesNo, PanicYesNo could be ignored
 	if (msg_handler && (AlertEnabled || Style == QUESTION || Style == CRITICAL))
 		return msg_handler(caption.c_str(), buffer, yes_no, Style);
@@ -19,6 +19,7 @@
 #define _MSGHANDLER_H_
 
 #include <string>
+#include <vector>
 
 // Message alerts
 enum MSG_TYPE
@@ -42,6 +43,9 @@ extern bool MsgAlert(bool yes_no, int Style, const char* format, ...)
 #endif
 	;
 void SetEnableAlert(bool enable);
+// Alerts from the calling thread are added to messages instead of going to
+// the handler, until it is called again with NULL. Yes/no alerts get a no
+void SetThreadAlertLog(std::vector<std::string> *messages);
 
 #ifndef GEKKO
 #ifdef _WIN32
@@ -206,7 +206,8 @@ public:
 		GetSystemInfo(&sysinfo);
 		return static_cast<unsigned>(sysinfo.dwNumberOfProcessors);
 #else
-		return 0;
+		long count = sysconf(_SC_NPROCESSORS_ONLN);
+		return count > 0 ? static_cast<unsigned>(count) : 0;
 #endif
 	}
 
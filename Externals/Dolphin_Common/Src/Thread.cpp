@@ -25,6 +25,10 @@
 #include <pthread_np.h>
 #endif
 
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
 #ifdef USE_BEGINTHREADEX
 #include <process.h>
 #endif
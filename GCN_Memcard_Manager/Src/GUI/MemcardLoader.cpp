@@ -0,0 +1,280 @@
+// Copyright (C) 2003 Dolphin Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official SVN repository and contact information can be found at
+// http://code.google.com/p/dolphin-emu/
+
+#include "MemcardLoader.h"
+
+DEFINE_EVENT_TYPE(wxEVT_MEMCARD_LOADER)
+
+namespace
+{
+
+class ThumbnailCacheInserter : public LinearDiskCacheReader<u64, u32>
+{
+public:
+	ThumbnailCacheInserter(std::map<u64, std::vector<u32> > &thumbnails)
+		: m_thumbnails(thumbnails)
+	{}
+
+	void Read(const u64 &key, const u32 *value, u32 value_size)
+	{
+		// anything else was written by a different version
+		if (value_size == 96*32 || value_size == 2*96*32)
+			m_thumbnails[key].assign(value, value + value_size);
+	}
+
+private:
+	std::map<u64, std::vector<u32> > &m_thumbnails;
+};
+
+}
+
+CMemcardLoader::CMemcardLoader(wxEvtHandler *handler, const std::string &cacheFile)
+	: m_handler(handler)
+	, m_quit(0)
+	, m_cacheFile(cacheFile)
+{
+	m_generation[SLOT_A] = m_generation[SLOT_B] = 0;
+	m_thread = std::thread(&CMemcardLoader::WorkerThread, this);
+}
+
+CMemcardLoader::~CMemcardLoader()
+{
+	Common::AtomicStore(m_quit, 1);
+	m_jobEvent.Set();
+	m_thread.join();
+	m_cache.Close();
+
+	// nobody takes these anymore
+	Job job;
+	while (m_jobs.Pop(job))
+		delete job.memcard;
+	Result result;
+	while (m_results.Pop(result))
+		delete result.memcard;
+}
+
+void CMemcardLoader::Load(int slot, const std::string &fileName)
+{
+	QueueJob(slot, fileName, NULL);
+}
+
+void CMemcardLoader::Refresh(int slot, GCMemcard *memcard, const std::string &fileName)
+{
+	QueueJob(slot, fileName, memcard);
+}
+
+void CMemcardLoader::QueueJob(int slot, const std::string &fileName, GCMemcard *memcard)
+{
+	Cancel(slot);
+
+	Job job;
+	job.slot = slot;
+	job.generation = Common::AtomicLoad(m_generation[slot]);
+	job.fileName = fileName;
+	job.memcard = memcard;
+	m_jobs.Push(job);
+	m_jobEvent.Set();
+}
+
+void CMemcardLoader::Cancel(int slot)
+{
+	Common::AtomicIncrement(m_generation[slot]);
+}
+
+bool CMemcardLoader::PopResult(Result &result)
+{
+	return m_results.Pop(result);
+}
+
+bool CMemcardLoader::IsCurrent(const Result &result)
+{
+	return result.generation == Common::AtomicLoad(m_generation[result.slot]);
+}
+
+void CMemcardLoader::WorkerThread(CMemcardLoader *loader)
+{
+	Common::SetCurrentThreadName("Memcard loader");
+
+	if (!loader->m_cacheFile.empty())
+	{
+		ThumbnailCacheInserter inserter(loader->m_thumbnails);
+		loader->m_cache.OpenAndRead(loader->m_cacheFile.c_str(), inserter);
+	}
+
+	while (true)
+	{
+		loader->m_jobEvent.Wait();
+		if (Common::AtomicLoad(loader->m_quit))
+			return;
+
+		Job job;
+		while (loader->m_jobs.Pop(job))
+			loader->ProcessJob(job);
+		loader->m_cache.Sync();
+	}
+}
+
+bool CMemcardLoader::IsStale(const Job &job)
+{
+	return Common::AtomicLoad(m_quit) || job.generation != Common::AtomicLoad(m_generation[job.slot]);
+}
+
+void CMemcardLoader::PushResult(const Result &result)
+{
+	m_results.Push(result);
+	wxCommandEvent event(wxEVT_MEMCARD_LOADER);
+	m_handler->AddPendingEvent(event);
+}
+
+void CMemcardLoader::ProcessJob(const Job &job)
+{
+	// the card was replaced before the worker got to it
+	if (IsStale(job))
+	{
+		delete job.memcard;
+		return;
+	}
+
+	Result result;
+	result.slot = job.slot;
+	result.generation = job.generation;
+	result.memcard = NULL;
+	result.ascii = false;
+	result.refresh = false;
+	result.row = 0;
+
+	GCMemcard *memcard = job.memcard;
+	if (memcard)
+		result.refresh = memcard->ReloadSystemBlocks(result.changed) == SUCCESS;
+	if (!result.refresh)
+	{
+		delete memcard;
+		memcard = new GCMemcard(job.fileName.c_str(), false, false, MemCard2043Mb, GCMemcard::LOAD_LAZY);
+		if (!memcard->IsValid())
+		{
+			delete memcard;
+			result.type = RESULT_FAILED;
+			PushResult(result);
+			return;
+		}
+	}
+
+	result.type = RESULT_FILES;
+	memcard->GetFileList(result.files);
+	result.ascii = memcard->IsAsciiEncoding();
+	PushResult(result);
+
+	// the list shows the text right away, the images follow row by row
+	std::vector<GCMemcard::FileInfo> files;
+	files.swap(result.files);
+	std::vector<bool> changed(DIRLEN, !result.refresh);
+	for (u32 i = 0; i < result.changed.size(); ++i)
+		changed[result.changed[i]] = true;
+	result.changed.clear();
+
+	result.type = RESULT_IMAGES;
+	for (u32 i = 0; i < files.size(); ++i)
+	{
+		if (!changed[files[i].index])
+			continue;
+		if (IsStale(job))
+		{
+			delete memcard;
+			return;
+		}
+		result.row = i;
+		LoadImages(*memcard, files[i].index, result);
+		PushResult(result);
+	}
+	result.banner.clear();
+	result.icon.clear();
+
+	result.type = RESULT_DONE;
+	result.memcard = memcard;
+	PushResult(result);
+}
+
+void CMemcardLoader::LoadImages(GCMemcard &memcard, u8 index, Result &result)
+{
+	u64 key = m_cacheFile.empty() ? 0 : memcard.GetImageHash(index);
+	if (key)
+	{
+		std::map<u64, std::vector<u32> >::const_iterator it = m_thumbnails.find(key);
+		if (it != m_thumbnails.end())
+		{
+			const std::vector<u32> &images = it->second;
+			result.banner.assign(images.begin(), images.begin() + 96*32);
+			result.icon.assign(images.begin() + 96*32, images.end());
+			return;
+		}
+	}
+
+	DecodeImages(memcard, index, result);
+
+	if (key)
+	{
+		std::vector<u32> &images = m_thumbnails[key];
+		images = result.banner;
+		images.insert(images.end(), result.icon.begin(), result.icon.end());
+		m_cache.Append(key, &images[0], (u32)images.size());
+	}
+}
+
+void CMemcardLoader::DecodeImages(GCMemcard &memcard, u8 index, Result &result)
+{
+	result.banner.assign(96*32, 0);
+	result.icon.clear();
+	u32 *pxdata = &result.banner[0];
+
+	int numFrames = memcard.ReadAnimRGBA8(index, m_animData, m_animDelay);
+
+	if (!memcard.ReadBannerRGBA8(index, pxdata))
+	{
+		memset(pxdata,0,96*32*4);
+
+		if (numFrames>0) // Just use the first one
+		{
+			u32 *icdata = m_animData;
+
+			for (int y=0;y<32;y++)
+			{
+				for (int x=0;x<32;x++)
+				{
+					pxdata[y*96+x+32] = icdata[y*32+x];//  | 0xFF000000
+				}
+			}
+		}
+	}
+
+	if (numFrames>0)
+	{
+		result.icon.assign(96*32, 0);
+		pxdata = &result.icon[0];
+		int frames=3;
+		if (numFrames<frames) frames=numFrames;
+		for (int f=0;f<frames;f++)
+		{
+			for (int y=0;y<32;y++)
+			{
+				for (int x=0;x<32;x++)
+				{
+					pxdata[y*96 + x + 32*f] = m_animData[f*32*32 + y*32 + x];
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,136 @@
+// Copyright (C) 2003 Dolphin Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official SVN repository and contact information can be found at
+// http://code.google.com/p/dolphin-emu/
+
+#ifndef __MEMCARD_LOADER_h__
+#define __MEMCARD_LOADER_h__
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <wx/wx.h>
+
+#include "Common.h"
+#include "FifoQueue.h"
+#include "LinearDiskCache.h"
+#include "Thread.h"
+#include "MemoryCards/GCMemcard.h"
+
+// sent to the handler every time the loader queues a result
+DECLARE_EVENT_TYPE(wxEVT_MEMCARD_LOADER, -1)
+
+// Loads memory cards and decodes their banners and icons on a worker
+// thread, so the GUI thread never waits on the card file. The results
+// are handed back through a FifoQueue, the GUI thread takes them with
+// PopResult when it gets a wxEVT_MEMCARD_LOADER event.
+//
+// A card is owned by the worker until its RESULT_DONE, the GUI only
+// gets the file list and the images before that.
+//
+// Decoded images are kept in a LinearDiskCache keyed by
+// GCMemcard::GetImageHash, a save that was seen before isn't decoded again.
+class CMemcardLoader : NonCopyable
+{
+public:
+	enum
+	{
+		RESULT_FILES = 0,	// the card loaded, files and ascii are set (and refresh and changed)
+		RESULT_IMAGES,		// banner and icon of files[row]
+		RESULT_DONE,		// every row was sent, memcard belongs to the GUI now
+		RESULT_FAILED,		// the card didn't load
+	};
+
+	struct Result
+	{
+		u8 type;
+		int slot;
+		u32 generation;
+		GCMemcard *memcard;
+		std::vector<GCMemcard::FileInfo> files;
+		bool ascii;
+		// RESULT_FILES of a Refresh that only had to read the system blocks,
+		// images follow for the files at the directory indices in changed
+		bool refresh;
+		std::vector<u8> changed;
+		u32 row;
+		std::vector<u32> banner,	// 96x32 RGBA
+						 icon;		// the first three frames side by side, empty for none
+	};
+
+	// an empty cacheFile decodes every save
+	CMemcardLoader(wxEvtHandler *handler, const std::string &cacheFile);
+	// cancels what's left and waits for the worker
+	~CMemcardLoader();
+
+	// starts loading fileName into slot, a load that is still running for
+	// the slot is cancelled
+	void Load(int slot, const std::string &fileName);
+	// takes memcard back from the GUI after its file changed, only the
+	// files whose DEntry changed are sent again. Falls back to a Load
+	// of fileName if the card can't just read its system blocks again
+	void Refresh(int slot, GCMemcard *memcard, const std::string &fileName);
+	void Cancel(int slot);
+
+	// GUI thread only. Results of cancelled loads still come out of the
+	// queue, IsCurrent is false for them and their memcard has to be deleted
+	bool PopResult(Result &result);
+	bool IsCurrent(const Result &result);
+
+private:
+	struct Job
+	{
+		int slot;
+		u32 generation;
+		std::string fileName;
+		GCMemcard *memcard;		// set for a Refresh
+	};
+
+	static void WorkerThread(CMemcardLoader *loader);
+	void ProcessJob(const Job &job);
+	void QueueJob(int slot, const std::string &fileName, GCMemcard *memcard);
+	void DecodeImages(GCMemcard &memcard, u8 index, Result &result);
+	void LoadImages(GCMemcard &memcard, u8 index, Result &result);
+	bool IsStale(const Job &job);
+	void PushResult(const Result &result);
+
+	wxEvtHandler *m_handler;
+
+	// GUI thread -> worker
+	Common::FifoQueue<Job> m_jobs;
+	Common::Event m_jobEvent;
+	// worker -> GUI thread
+	Common::FifoQueue<Result> m_results;
+
+	// bumped by the GUI thread for every Load/Cancel, the worker drops a
+	// job as soon as the job's generation is no longer the slot's
+	volatile u32 m_generation[2];
+	volatile u32 m_quit;
+
+	// only used by the worker
+	u8 m_animDelay[8];
+	u32 m_animData[32*32*8];
+
+	// the banner followed by the icon strip (if there is one) of every
+	// save in the cache file, read when the worker starts
+	std::string m_cacheFile;
+	LinearDiskCache<u64, u32> m_cache;
+	std::map<u64, std::vector<u32> > m_thumbnails;
+
+	std::thread m_thread;
+};
+
+#endif
@@ -21,54 +21,34 @@
 
 #define ARROWS slot ? _T("") : ARROW[slot], slot ? ARROW[slot] : _T("")
 
-const u8 hdr[] = {
-0x42,0x4D,
-0x38,0x30,0x00,0x00,
-0x00,0x00,0x00,0x00,
-0x36,0x00,0x00,0x00,
-0x28,0x00,0x00,0x00,
-0x20,0x00,0x00,0x00, //W
-0x20,0x00,0x00,0x00, //H
-0x01,0x00,
-0x20,0x00,
-0x00,0x00,0x00,0x00,
-0x02,0x30,0x00,0x00, //data size
-0x12,0x0B,0x00,0x00,
-0x12,0x0B,0x00,0x00,
-0x00,0x00,0x00,0x00,
-0x00,0x00,0x00,0x00
-};
-
-wxBitmap wxBitmapFromMemoryRGBA(const unsigned char* data, int width, int height)
-{
-	int stride = (4*width);
-
-	int bytes = (stride*height) + sizeof(hdr);
-
-	bytes = (bytes+3)&(~3);
-
-	u8 *pdata = new u8[bytes];
+DEFINE_EVENT_TYPE(wxEVT_MEMCARD_ALERT)
 
-	memset(pdata,0,bytes);
-	memcpy(pdata,hdr,sizeof(hdr));
-
-	u8 *pixelData = pdata + sizeof(hdr);
-
-	for (int y=0;y<height;y++)
+// writes the ARGB pixels ColorUtil decodes straight into the RGB and alpha
+// planes of a wxImage. The planes are only lent to the image (static_data),
+// the bitmap made from it has its own copy, so they are reused for every
+// bitmap. GUI thread only.
+wxBitmap wxBitmapFromMemoryRGBA(const u32* data, int width, int height)
+{
+	static std::vector<u8> rgb, alpha;
+	const int pixels = width*height;
+	if ((int)alpha.size() < pixels)
 	{
-		memcpy(pixelData+y*stride,data+(height-y-1)*stride,stride);
+		rgb.resize(pixels*3);
+		alpha.resize(pixels);
 	}
 
-	*(int*)(pdata+18) = width;
-	*(int*)(pdata+22) = height;
-	*(u32*)(pdata+34) = bytes-sizeof(hdr);
-
-	wxMemoryInputStream is(pdata, bytes);
-	wxBitmap map(wxImage(is, wxBITMAP_TYPE_BMP, -1), -1);
-
-	delete [] pdata;
+	u8 *rgbData = &rgb[0];
+	for (int i = 0; i < pixels; i++)
+	{
+		const u32 px = data[i];
+		rgbData[i*3]   = (px >> 16) & 0xFF;
+		rgbData[i*3+1] = (px >> 8) & 0xFF;
+		rgbData[i*3+2] = px & 0xFF;
+		alpha[i] = px >> 24;
+	}
 
-	return map;
+	wxImage image(width, height, rgbData, &alpha[0], true);
+	return wxBitmap(image, -1);
 }
 
 BEGIN_EVENT_TABLE(CMemcardManager, wxFrame)
@@ -82,19 +62,18 @@ BEGIN_EVENT_TABLE(CMemcardManager, wxFrame)
 	EVT_BUTTON(ID_SAVEIMPORT_A,CMemcardManager::CopyDeleteClick)
 	EVT_BUTTON(ID_SAVEEXPORT_A,CMemcardManager::CopyDeleteClick)
 	EVT_BUTTON(ID_CONVERTTOGCI,CMemcardManager::CopyDeleteClick)
-	EVT_BUTTON(ID_PREVPAGE_A, CMemcardManager::OnPageChange)
-	EVT_BUTTON(ID_NEXTPAGE_A, CMemcardManager::OnPageChange)
-	EVT_BUTTON(ID_PREVPAGE_B, CMemcardManager::OnPageChange)
-	EVT_BUTTON(ID_NEXTPAGE_B, CMemcardManager::OnPageChange)
 
 	EVT_FILEPICKER_CHANGED(ID_MEMCARDPATH_A,CMemcardManager::OnPathChange)
 	EVT_FILEPICKER_CHANGED(ID_MEMCARDPATH_B,CMemcardManager::OnPathChange)
+
+	EVT_COMMAND(wxID_ANY, wxEVT_MEMCARD_LOADER, CMemcardManager::OnLoaderUpdate)
+	EVT_COMMAND(wxID_ANY, wxEVT_MEMCARD_CHANGED, CMemcardManager::OnMemcardChanged)
+	EVT_COMMAND(wxID_ANY, wxEVT_MEMCARD_ALERT, CMemcardManager::OnAlert)
 	
 	EVT_MENU_RANGE(IDM_NEWMEMCARD_A, IDM_RESIZE_B, CMemcardManager::TestFunctions)
 
-	EVT_MENU_RANGE(ID_MEMCARDPATH_A, ID_USEPAGES, CMemcardManager::OnMenuChange)
+	EVT_MENU_RANGE(ID_MEMCARDPATH_A, ID_MEMCARDPATH_B, CMemcardManager::OnMenuChange)
 	EVT_MENU_RANGE(ID_COPYFROM_A, ID_CONVERTTOGCI, CMemcardManager::CopyDeleteClick)
-	EVT_MENU_RANGE(ID_NEXTPAGE_A, ID_PREVPAGE_B, CMemcardManager::OnPageChange)
 	EVT_MENU_RANGE(COLUMN_BANNER, NUMBER_OF_COLUMN, CMemcardManager::OnMenuChange)
 END_EVENT_TABLE()
 
@@ -119,8 +98,8 @@ void CMemcardManager::TestFunctions(wxCommandEvent& event)
 			path = wxFileSelector(
 				_("Choose a memory card:"),
 				wxString::From8BitData(File::GetUserPath(D_GCUSER_IDX).c_str()), wxEmptyString, wxEmptyString,
-				_("Gamecube Memory Cards (*.raw,*.gcp,*.mci)") +
-				wxString(wxT("|*.raw;*.gcp;*.mci")),
+				_("Gamecube Memory Cards (*.raw,*.gcp,*.mci,*.mcz)") +
+				wxString(wxT("|*.raw;*.gcp;*.mci;*.mcz")),
 				wxFD_OPEN | wxFD_FILE_MUST_EXIST,
 				this);
 		m_MemcardPath[id - IDM_OPENMEMCARD_A]->SetPath(path);
@@ -134,8 +113,8 @@ void CMemcardManager::TestFunctions(wxCommandEvent& event)
 			path = wxFileSelector(
 				_("Save memory card as:"),
 				wxString::From8BitData(File::GetUserPath(D_GCUSER_IDX).c_str()), wxEmptyString, wxEmptyString,
-				_("Gamecube Memory Cards (*.raw,*.gcp,*.mci)") +
-				wxString(wxT("|*.raw;*.gcp;*.mci")),
+				_("Gamecube Memory Cards (*.raw,*.gcp,*.mci,*.mcz)") +
+				wxString(wxT("|*.raw;*.gcp;*.mci;*.mcz")),
 				wxFD_SAVE| wxFD_OVERWRITE_PROMPT,
 				this);
 			if (memcard->SaveAs(path.mb_str()))
@@ -172,20 +151,25 @@ CMemcardManager::CMemcardManager(wxWindow* parent, wxWindowID id, const wxString
 {
 	memoryCard[SLOT_A]=NULL;
 	memoryCard[SLOT_B]=NULL;
+#ifdef GCNMCMAPP
+	m_Loader = new CMemcardLoader(this, MEMCMAN_CACHE_FILE);
+#else
+	File::CreateFullPath(File::GetUserPath(D_CACHE_IDX));
+	m_Loader = new CMemcardLoader(this, File::GetUserPath(D_CACHE_IDX) + "MemcardManager.cache");
+#endif
+	m_Watcher = new CMemcardWatcher(this);
+	m_AlertResult = false;
+	m_Closing = 0;
 
 	mcmSettings.twoCardsLoaded = false;
 	if (!LoadSettings())
 	{
-		itemsPerPage = 16;
-		mcmSettings.usePages = true;
 		for (int i = COLUMN_BANNER; i < NUMBER_OF_COLUMN; i++)
 		{
 			mcmSettings.column[i] = (i <= COLUMN_FIRSTBLOCK)? true:false;
 		}
 	}
 
-	maxPages = (128 / itemsPerPage) - 1;
-
 #ifdef MCM_DEBUG_FRAME
 	MemcardManagerDebug = NULL;
 #endif
@@ -198,6 +182,12 @@ CMemcardManager::CMemcardManager(wxWindow* parent, wxWindowID id, const wxString
 
 CMemcardManager::~CMemcardManager()
 {
+	// the loader may be waiting for an alert that won't be answered anymore
+	Common::AtomicStore(m_Closing, 1);
+	m_AlertEvent.Set();
+	delete m_Watcher;
+	delete m_Loader;
+
 	if (memoryCard[SLOT_A])
 	{
 		delete memoryCard[SLOT_A];
@@ -230,12 +220,10 @@ bool CMemcardManager::LoadSettings()
 #endif
 	{
 		iniMemcardSection = MemcardManagerIni.GetOrCreateSection("MemcardManager");
-		iniMemcardSection->Get("Items per page",  &itemsPerPage, 16);
 		iniMemcardSection->Get("DefaultMemcardA", &(DefaultMemcard[SLOT_A]), "");
 		iniMemcardSection->Get("DefaultMemcardB", &(DefaultMemcard[SLOT_B]), "");
 		iniMemcardSection->Get("DefaultIOFolder", &DefaultIOPath, "/Users/GC");
 
-		iniMemcardSection->Get("Use Pages", &mcmSettings.usePages, true);
 		iniMemcardSection->Get("cBanner", &mcmSettings.column[COLUMN_BANNER], true);
 		iniMemcardSection->Get("cTitle", &mcmSettings.column[COLUMN_TITLE], true);
 		iniMemcardSection->Get("cComment", &mcmSettings.column[COLUMN_COMMENT], true);
@@ -265,11 +253,9 @@ bool CMemcardManager::SaveSettings()
 	MemcardManagerIni.Load(File::GetUserPath(F_DOLPHINCONFIG_IDX));
 #endif
 	iniMemcardSection = MemcardManagerIni.GetOrCreateSection("MemcardManager");
-	iniMemcardSection->Set("Items per page",  itemsPerPage, 16);
 	iniMemcardSection->Set("DefaultMemcardA", DefaultMemcard[SLOT_A], "");
 	iniMemcardSection->Set("DefaultMemcardB", DefaultMemcard[SLOT_B], "");
 
-	iniMemcardSection->Set("Use Pages", mcmSettings.usePages, true);
 	iniMemcardSection->Set("cBanner", mcmSettings.column[COLUMN_BANNER], true);
 	iniMemcardSection->Set("cTitle", mcmSettings.column[COLUMN_TITLE], true);
 	iniMemcardSection->Set("cComment", mcmSettings.column[COLUMN_COMMENT], true);
@@ -338,31 +324,41 @@ void CMemcardManager::CreateGUIControls()
 		m_Delete[slot]		= new wxButton(this, ID_DELETE_A + slot,
 			wxString::Format(_("%sDelete%s"), ARROWS));
 
-
-		m_PrevPage[slot] = new wxButton(this, ID_PREVPAGE_A + slot, _("Prev Page"));
-		m_NextPage[slot] = new wxButton(this, ID_NEXTPAGE_A + slot, _("Next Page"));
-
 		t_Status[slot] = new wxStaticText(this, 0, wxEmptyString, wxDefaultPosition,wxDefaultSize, 0, wxEmptyString);
 
-		wxBoxSizer * const sPages = new wxBoxSizer(wxHORIZONTAL);
-		sPages->Add(m_PrevPage[slot], 0, wxEXPAND|wxALL, 1);
-		sPages->Add(t_Status[slot],0, wxEXPAND|wxALL, 5);
-		sPages->Add(0, 0, 1, wxEXPAND|wxALL, 0);
-		sPages->Add(m_NextPage[slot], 0, wxEXPAND|wxALL, 1);
-
 		m_MemcardPath[slot] = new wxFilePickerCtrl(this, ID_MEMCARDPATH_A + slot,
 			 wxString::From8BitData(File::GetUserPath(D_GCUSER_IDX).c_str()), _("Choose a memory card:"),
-		_("Gamecube Memory Cards (*.raw,*.gcp,*.mci)") + wxString(wxT("|*.raw;*.gcp;*.mci")), wxDefaultPosition, wxDefaultSize, wxFLP_USE_TEXTCTRL|wxFLP_OPEN);
+		_("Gamecube Memory Cards (*.raw,*.gcp,*.mci,*.mcz)") + wxString(wxT("|*.raw;*.gcp;*.mci;*.mcz")), wxDefaultPosition, wxDefaultSize, wxFLP_USE_TEXTCTRL|wxFLP_OPEN);
 	
 		m_MemcardList[slot] = new CMemcardListCtrl(this, ID_MEMCARDLIST_A + slot, wxDefaultPosition, wxSize(350,400),
-		wxLC_REPORT | wxSUNKEN_BORDER | wxLC_ALIGN_LEFT | wxLC_SINGLE_SEL, mcmSettings);
+		wxLC_REPORT | wxLC_VIRTUAL | wxSUNKEN_BORDER | wxLC_ALIGN_LEFT | wxLC_SINGLE_SEL, mcmSettings);
 	
 		m_MemcardList[slot]->AssignImageList(new wxImageList(96,32),wxIMAGE_LIST_SMALL);
 
+		m_MemcardList[slot]->InsertColumn(COLUMN_BANNER, _("Banner"));
+		m_MemcardList[slot]->InsertColumn(COLUMN_TITLE, _("Title"));
+		m_MemcardList[slot]->InsertColumn(COLUMN_COMMENT, _("Comment"));
+		m_MemcardList[slot]->InsertColumn(COLUMN_ICON, _("Icon"));
+		m_MemcardList[slot]->InsertColumn(COLUMN_BLOCKS, _("Blocks"));
+		m_MemcardList[slot]->InsertColumn(COLUMN_FIRSTBLOCK, _("First Block"));
+#ifdef DEBUG_MCM
+		m_MemcardList[slot]->InsertColumn(COLUMN_GAMECODE, _("GameCode"));
+		m_MemcardList[slot]->InsertColumn(COLUMN_MAKERCODE, _("MakerCode"));
+		m_MemcardList[slot]->InsertColumn(COLUMN_BIFLAGS, _("BIFLAGS"));
+		m_MemcardList[slot]->InsertColumn(COLUMN_FILENAME, _("FILENAME"));
+		m_MemcardList[slot]->InsertColumn(COLUMN_MODTIME, _("MODTIME"));
+		m_MemcardList[slot]->InsertColumn(COLUMN_IMAGEADD, _("IMAGEADD"));
+		m_MemcardList[slot]->InsertColumn(COLUMN_ICONFMT, _("ICONFMT"));
+		m_MemcardList[slot]->InsertColumn(COLUMN_ANIMSPEED, _("ANIMSPEED"));
+		m_MemcardList[slot]->InsertColumn(COLUMN_PERMISSIONS, _("PERMISSIONS"));
+		m_MemcardList[slot]->InsertColumn(COLUMN_COPYCOUNTER, _("COPYCOUNTER"));
+		m_MemcardList[slot]->InsertColumn(COLUMN_COMMENTSADDRESS, _("COMMENTSADDRESS"));
+#endif
+
 		sMemcard[slot] = new wxStaticBoxSizer(wxVERTICAL, this, _("Memory Card") + wxString::Format(wxT(" %c"), 'A' + slot));
 		sMemcard[slot]->Add(m_MemcardPath[slot], 0, wxEXPAND|wxALL, 5);
 		sMemcard[slot]->Add(m_MemcardList[slot], 1, wxEXPAND|wxALL, 5);
-		sMemcard[slot]->Add(sPages, 0, wxEXPAND|wxALL, 1);
+		sMemcard[slot]->Add(t_Status[slot], 0, wxEXPAND|wxALL, 5);
 	}
 
 	wxBoxSizer * const sButtons = new wxBoxSizer(wxVERTICAL);
@@ -395,8 +391,6 @@ void CMemcardManager::CreateGUIControls()
 
 	for (int i = SLOT_A; i <= SLOT_B; i++)
 	{
-		m_PrevPage[i]->Disable();
-		m_NextPage[i]->Disable();
 		m_CopyFrom[i]->Disable();
 		m_SaveImport[i]->Disable();
 		m_SaveExport[i]->Disable();
@@ -421,9 +415,6 @@ void CMemcardManager::OnPathChange(wxFileDirPickerEvent& event)
 
 void CMemcardManager::ChangePath(int slot)
 {
-	int slot2 = (slot == SLOT_A) ? SLOT_B : SLOT_A;
-	page[slot] = FIRSTPAGE;
-
 	if (m_MemcardPath[slot]->GetPath() != wxEmptyString && !File::Exists(std::string(m_MemcardPath[slot]->GetPath().mb_str())))
 	{
 		wxString path = m_MemcardPath[slot]->GetPath();
@@ -432,104 +423,52 @@ void CMemcardManager::ChangePath(int slot)
 		return;
 	}
 
-	if (mcmSettings.usePages && m_PrevPage[slot]->IsEnabled())
-	{
-		m_PrevPage[slot]->Disable();
-		m_MemcardList[slot]->prevPage = false;
-	}
 	if (!m_MemcardPath[SLOT_A]->GetPath().CmpNoCase(m_MemcardPath[SLOT_B]->GetPath()))
 	{
 		if(m_MemcardPath[slot]->GetPath().length())
 			PanicAlertT("Memcard already opened");
 	}
+	else if (m_MemcardPath[slot]->GetPath().length())
+	{
+		ReloadMemcard(m_MemcardPath[slot]->GetPath().mb_str(), slot);
+	}
 	else
 	{
-		if (m_MemcardPath[slot]->GetPath().length() && ReloadMemcard(m_MemcardPath[slot]->GetPath().mb_str(), slot))
-		{
-			if (memoryCard[slot2])
-			{
-				mcmSettings.twoCardsLoaded = true;
-			}
-			m_SaveImport[slot]->Enable();
-			m_SaveExport[slot]->Enable();
-			m_Delete[slot]->Enable();
-			
-			wxMenuBar const * tmpMenu = GetMenuBar();
-			//tmpMenu->FindItem(IDM_NEWMEMCARD_A + slot)->Enable();
-			//tmpMenu->FindItem(IDM_OPENMEMCARD_A + slot)->Enable();
-			tmpMenu->FindItem(IDM_SAVEAS_A + slot)->Enable();
-			tmpMenu->FindItem(IDM_RESIZE_A + slot)->Enable();
-		}
-		else
-		{
-			if (memoryCard[slot])
-			{
-				delete memoryCard[slot];
-				memoryCard[slot] = NULL;
-			}
-			wxMenuBar const * tmpMenu = GetMenuBar();
-			//tmpMenu->FindItem(IDM_NEWMEMCARD_A + slot)->Enable();
-			//tmpMenu->FindItem(IDM_OPENMEMCARD_A + slot)->Enable();
-			tmpMenu->FindItem(IDM_SAVEAS_A + slot)->Enable(false);
-			tmpMenu->FindItem(IDM_RESIZE_A + slot)->Enable(false);
-
-			mcmSettings.twoCardsLoaded = false;
-			m_MemcardPath[slot]->SetPath(wxEmptyString);
-			m_MemcardList[slot]->ClearAll();
-			t_Status[slot]->SetLabel(wxEmptyString);
-			m_SaveImport[slot]->Disable();
-			m_SaveExport[slot]->Disable();
-			m_Delete[slot]->Disable();
-			if (mcmSettings.usePages)
-			{
-				m_PrevPage[slot]->Disable();
-				m_NextPage[slot]->Disable();
-			}
-		}
+		CloseMemcard(slot);
 	}
-
-	m_CopyFrom[SLOT_A]->Enable(mcmSettings.twoCardsLoaded);
-	m_CopyFrom[SLOT_B]->Enable(mcmSettings.twoCardsLoaded);
 }
 
-void CMemcardManager::OnPageChange(wxCommandEvent& event)
+void CMemcardManager::CloseMemcard(int slot)
 {
-	int slot = SLOT_B;
-	switch (event.GetId())
+	m_Loader->Cancel(slot);
+	m_Watcher->Watch(slot, std::string());
+	m_MemcardList[slot]->SetMemcard(NULL);
+	m_MemcardList[slot]->SetFiles(std::vector<GCMemcard::FileInfo>(), true);
+	if (memoryCard[slot])
 	{
-	case ID_NEXTPAGE_A:
-		slot = SLOT_A;
-	case ID_NEXTPAGE_B:
-		if (!m_PrevPage[slot]->IsEnabled())
-		{
-			m_PrevPage[slot]->Enable();
-			m_MemcardList[slot]->prevPage = true;
-		}
-		page[slot]++;
-		if (page[slot] == maxPages)
-		{
-			m_NextPage[slot]->Disable();
-			m_MemcardList[slot]->nextPage = false;
-		}
-		ReloadMemcard(m_MemcardPath[slot]->GetPath().mb_str(), slot);
-		break;
-	case ID_PREVPAGE_A:
-		slot = SLOT_A;
-	case ID_PREVPAGE_B:
-		if (!m_NextPage[slot]->IsEnabled())
-		{
-			m_NextPage[slot]->Enable();
-			m_MemcardList[slot]->nextPage = true;
-		}
-		page[slot]--;
-		if (!page[slot])
-		{
-			m_PrevPage[slot]->Disable();
-			m_MemcardList[slot]->prevPage = false;
-		}
-		ReloadMemcard(m_MemcardPath[slot]->GetPath().mb_str(), slot);
-		break;
+		delete memoryCard[slot];
+		memoryCard[slot] = NULL;
 	}
+	m_MemcardPath[slot]->SetPath(wxEmptyString);
+	t_Status[slot]->SetLabel(wxEmptyString);
+	EnableMemcard(slot, false);
+}
+
+void CMemcardManager::EnableMemcard(int slot, bool enable)
+{
+	m_SaveImport[slot]->Enable(enable);
+	m_SaveExport[slot]->Enable(enable);
+	m_Delete[slot]->Enable(enable);
+
+	wxMenuBar const * tmpMenu = GetMenuBar();
+	//tmpMenu->FindItem(IDM_NEWMEMCARD_A + slot)->Enable(enable);
+	//tmpMenu->FindItem(IDM_OPENMEMCARD_A + slot)->Enable(enable);
+	tmpMenu->FindItem(IDM_SAVEAS_A + slot)->Enable(enable);
+	tmpMenu->FindItem(IDM_RESIZE_A + slot)->Enable(enable);
+
+	mcmSettings.twoCardsLoaded = memoryCard[SLOT_A] && memoryCard[SLOT_B];
+	m_CopyFrom[SLOT_A]->Enable(mcmSettings.twoCardsLoaded);
+	m_CopyFrom[SLOT_B]->Enable(mcmSettings.twoCardsLoaded);
 }
 
 void CMemcardManager::OnMenuChange(wxCommandEvent& event)
@@ -541,20 +480,6 @@ void CMemcardManager::OnMenuChange(wxCommandEvent& event)
 	case ID_MEMCARDPATH_B:
 		DefaultMemcard[_id - ID_MEMCARDPATH_A] = m_MemcardPath[_id - ID_MEMCARDPATH_A]->GetPath().mb_str();
 		return;
-	case ID_USEPAGES:
-		mcmSettings.usePages = !mcmSettings.usePages;
-		if (!mcmSettings.usePages)
-		{
-			m_PrevPage[SLOT_A]->Disable();
-			m_PrevPage[SLOT_B]->Disable();
-			m_NextPage[SLOT_A]->Disable();
-			m_NextPage[SLOT_B]->Disable();
-			m_MemcardList[SLOT_A]->prevPage =
-			m_MemcardList[SLOT_B]->prevPage = false;
-			page[SLOT_A] =
-			page[SLOT_B] = FIRSTPAGE;
-		}
-		break;
 	case NUMBER_OF_COLUMN:
 		for (int i = COLUMN_GAMECODE; i <= NUMBER_OF_COLUMN; i++)
 		{
@@ -566,8 +491,8 @@ void CMemcardManager::OnMenuChange(wxCommandEvent& event)
 		break;
 	}
 
-	if (memoryCard[SLOT_A])	ReloadMemcard(m_MemcardPath[SLOT_A]->GetPath().mb_str(), SLOT_A);
-	if (memoryCard[SLOT_B])	ReloadMemcard(m_MemcardPath[SLOT_B]->GetPath().mb_str(), SLOT_B);
+	ResizeColumns(SLOT_A);
+	ResizeColumns(SLOT_B);
 }
 bool CMemcardManager::CopyDeleteSwitch(u32 error, int slot)
 {
@@ -581,7 +506,6 @@ bool CMemcardManager::CopyDeleteSwitch(u32 error, int slot)
 		{
 			memoryCard[slot]->FixChecksums();
 			if (!memoryCard[slot]->Save()) PanicAlert(E_SAVEFAILED);
-			page[slot] = FIRSTPAGE;
 			ReloadMemcard(m_MemcardPath[slot]->GetPath().mb_str(), slot);
 		}
 		break;
@@ -639,6 +563,24 @@ bool CMemcardManager::CopyDeleteSwitch(u32 error, int slot)
 	return true;
 }
 
+void CMemcardManager::ExportAllReport(const GCMemcard::ExportReport &report)
+{
+	if (report.numExported == report.saves.size())
+	{
+		SuccessAlertT("%u saves exported", report.numExported);
+		return;
+	}
+
+	std::string failed;
+	for (u32 i = 0; i < report.saves.size(); ++i)
+	{
+		if (report.saves[i].result != SUCCESS)
+			failed += "\n" + report.saves[i].fileName;
+	}
+	PanicAlertT("%u of %u saves could not be exported:%s", (u32)(report.saves.size() - report.numExported),
+		(u32)report.saves.size(), failed.c_str());
+}
+
 void CMemcardManager::CopyDeleteClick(wxCommandEvent& event)
 {
 	int index_A = m_MemcardList[SLOT_A]->GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED);
@@ -647,9 +589,6 @@ void CMemcardManager::CopyDeleteClick(wxCommandEvent& event)
 	int slot2 = SLOT_A;
 	std::string fileName2("");
 
-	if (index_A != wxNOT_FOUND && page[SLOT_A]) index_A += itemsPerPage * page[SLOT_A];
-	if (index_B != wxNOT_FOUND && page[SLOT_B]) index_B += itemsPerPage * page[SLOT_B];
-
 	int index = index_B;
 	switch (event.GetId())
 	{
@@ -673,24 +612,45 @@ void CMemcardManager::CopyDeleteClick(wxCommandEvent& event)
 		}
 		else PanicAlert(E_SAVEFAILED);
 		break; 
+	case ID_DEFRAG_A:
+		slot = SLOT_A;
+	case ID_DEFRAG_B:
+	{
+		u16 movedBlocks;
+		u8 movedFiles;
+		u32 result = memoryCard[slot]->Defragment(movedBlocks, movedFiles);
+		if (result == SUCCESS && !movedBlocks)
+			SuccessAlertT("Every save is already stored in one run of blocks");
+		else
+			CopyDeleteSwitch(result, slot);
+		break;
+	}
 	case ID_CONVERTTOGCI:
 		fileName2 = "convert";
 	case ID_SAVEIMPORT_A:
 		slot = SLOT_A;
 	case ID_SAVEIMPORT_B:
 	{
-		wxString fileName = wxFileSelector(
+		// several saves can be imported at once, but only one converted
+		wxFileDialog openDialog(this,
 			_("Select a save file to import"),
 			(strcmp(DefaultIOPath.c_str(), "/Users/GC") == 0)
 				? wxString::FromAscii("")
 				: wxString::From8BitData(DefaultIOPath.c_str()),
-			wxEmptyString, wxEmptyString,
+			wxEmptyString,
 			_("GameCube Savegame files(*.gci;*.gcs;*.sav)") + wxString(wxT("|*.gci;*.gcs;*.sav|")) +
 			_("Native GCI files(*.gci)") + wxString(wxT("|*.gci|")) +
 			_("MadCatz Gameshark files(*.gcs)") + wxString(wxT("|*.gcs|")) +
 			_("Datel MaxDrive/Pro files(*.sav)") + wxString(wxT("|*.sav")),
-			wxFD_OPEN | wxFD_FILE_MUST_EXIST);
-		if (!fileName.empty() && !fileName2.empty())
+			wxFD_OPEN | wxFD_FILE_MUST_EXIST | (fileName2.empty() ? wxFD_MULTIPLE : 0));
+		if (openDialog.ShowModal() != wxID_OK)
+			break;
+		wxArrayString fileNames;
+		openDialog.GetPaths(fileNames);
+		if (fileNames.empty())
+			break;
+
+		if (!fileName2.empty())
 		{
 			wxString temp2 = wxFileSelector(_("Save GCI as..."),
 				wxEmptyString, wxEmptyString, wxT(".gci"),
@@ -698,11 +658,27 @@ void CMemcardManager::CopyDeleteClick(wxCommandEvent& event)
 				wxFD_OVERWRITE_PROMPT|wxFD_SAVE);
 			if (temp2.empty()) break;
 			fileName2 = temp2.mb_str();
+			CopyDeleteSwitch(memoryCard[slot]->ImportGci(fileNames[0].mb_str(), fileName2), slot);
+			break;
 		}
-		if (fileName.length() > 0)
+
+		std::vector<std::string> inputFiles;
+		for (u32 i = 0; i < fileNames.size(); ++i)
+			inputFiles.push_back(std::string(fileNames[i].mb_str()));
+		std::vector<u32> results;
+		u32 result = memoryCard[slot]->ImportBatch(inputFiles, results);
+		// all of them are imported and saved at once, or none
+		bool reported = false;
+		for (u32 i = 0; i < results.size(); ++i)
 		{
-			CopyDeleteSwitch(memoryCard[slot]->ImportGci(fileName.mb_str(), fileName2), slot);
+			if (results[i] != SUCCESS)
+			{
+				CopyDeleteSwitch(results[i], slot);
+				reported = true;
+			}
 		}
+		if (!reported)
+			CopyDeleteSwitch(result, slot);
 	}
 	break;
 	case ID_SAVEEXPORT_A:
@@ -747,9 +723,30 @@ void CMemcardManager::CopyDeleteClick(wxCommandEvent& event)
 		File::CreateDir(path1);
 		if(PanicYesNoT("Warning: This will overwrite any existing saves that are in the folder:\n"
 					"%s\nand have the same name as a file on your memcard\nContinue?", path1.c_str()))
-		for (int i = 0; i < DIRLEN; i++)
 		{
-			CopyDeleteSwitch(memoryCard[slot]->ExportGci(i, NULL, path1), -1);
+			GCMemcard::ExportReport report;
+			memoryCard[slot]->ExportAll(path1, report);
+			ExportAllReport(report);
+		}
+		break;
+	}
+	case ID_EXPORTTAR_A:
+		slot = SLOT_A;
+	case ID_EXPORTTAR_B:
+	{
+		std::string path, name;
+		SplitPath(std::string(m_MemcardPath[slot]->GetPath().mb_str()), &path, &name, NULL);
+		wxString fileName = wxFileSelector(
+			_("Export all saves as..."),
+			wxString::From8BitData(path.c_str()),
+			wxString::From8BitData((name + ".tar").c_str()), wxT(".tar"),
+			_("Tar files(*.tar)") + wxString(wxT("|*.tar")),
+			wxFD_OVERWRITE_PROMPT|wxFD_SAVE);
+		if (fileName.length() > 0)
+		{
+			GCMemcard::ExportReport report;
+			memoryCard[slot]->ExportAll(std::string(fileName.mb_str()), report);
+			ExportAllReport(report);
 		}
 		break;
 	}
@@ -766,211 +763,134 @@ void CMemcardManager::CopyDeleteClick(wxCommandEvent& event)
 	}
 }
 
-bool CMemcardManager::ReloadMemcard(const char *fileName, int card)
+void CMemcardManager::ReloadMemcard(const char *fileName, int card)
 {
-	if (memoryCard[card]) delete memoryCard[card];
-
-	// TODO: add error checking and animate icons
-	memoryCard[card] = new GCMemcard(fileName);
-
-	if (!memoryCard[card]->IsValid()) return false;
-
-	int j;
-
-	wxString wxTitle,
-			 wxComment,
-			 wxBlock,
-			 wxFirstBlock,
-			 wxLabel;
-
+	// OnLoaderUpdate fills the list in and enables the card again when
+	// the loader is done with it
+	m_MemcardList[card]->SetMemcard(NULL);
+	m_MemcardList[card]->SetFiles(std::vector<GCMemcard::FileInfo>(), true);
+	if (memoryCard[card])
+	{
+		delete memoryCard[card];
+		memoryCard[card] = NULL;
+	}
+	EnableMemcard(card, false);
+	t_Status[card]->SetLabel(_("Loading..."));
 
-	m_MemcardList[card]->Hide();
-	m_MemcardList[card]->ClearAll();
+	m_Loader->Load(card, fileName);
+	m_Watcher->Watch(card, fileName);
+}
 
-	m_MemcardList[card]->InsertColumn(COLUMN_BANNER, _("Banner"));
-	m_MemcardList[card]->InsertColumn(COLUMN_TITLE, _("Title"));
-	m_MemcardList[card]->InsertColumn(COLUMN_COMMENT, _("Comment"));
-	m_MemcardList[card]->InsertColumn(COLUMN_ICON, _("Icon"));
-	m_MemcardList[card]->InsertColumn(COLUMN_BLOCKS, _("Blocks"));
-	m_MemcardList[card]->InsertColumn(COLUMN_FIRSTBLOCK, _("First Block"));
-#ifdef DEBUG_MCM
-	m_MemcardList[card]->InsertColumn(COLUMN_GAMECODE, _("GameCode"));
-	m_MemcardList[card]->InsertColumn(COLUMN_MAKERCODE, _("MakerCode"));
-	m_MemcardList[card]->InsertColumn(COLUMN_BIFLAGS, _("BIFLAGS"));
-	m_MemcardList[card]->InsertColumn(COLUMN_FILENAME, _("FILENAME"));
-	m_MemcardList[card]->InsertColumn(COLUMN_MODTIME, _("MODTIME"));
-	m_MemcardList[card]->InsertColumn(COLUMN_IMAGEADD, _("IMAGEADD"));
-	m_MemcardList[card]->InsertColumn(COLUMN_ICONFMT, _("ICONFMT"));
-	m_MemcardList[card]->InsertColumn(COLUMN_ANIMSPEED, _("ANIMSPEED"));
-	m_MemcardList[card]->InsertColumn(COLUMN_PERMISSIONS, _("PERMISSIONS"));
-	m_MemcardList[card]->InsertColumn(COLUMN_COPYCOUNTER, _("COPYCOUNTER"));
-	m_MemcardList[card]->InsertColumn(COLUMN_COMMENTSADDRESS, _("COMMENTSADDRESS"));
-#endif
+void CMemcardManager::OnMemcardChanged(wxCommandEvent& event)
+{
+	// a card that is still loading reads the new file anyway
+	int slot = event.GetInt();
+	if (!memoryCard[slot])
+		return;
 
-	wxImageList *list = m_MemcardList[card]->GetImageList(wxIMAGE_LIST_SMALL);
-	list->RemoveAll();
+	// the loader owns the card until it's done, like after ReloadMemcard,
+	// but the list keeps showing the old files until it sent the new ones
+	GCMemcard *memcard = memoryCard[slot];
+	memoryCard[slot] = NULL;
+	m_MemcardList[slot]->SetMemcard(NULL);
+	EnableMemcard(slot, false);
 
-	u8 nFiles = memoryCard[card]->GetNumFiles();
-	int *images = new int[nFiles*2];
+	m_Loader->Refresh(slot, memcard, std::string(m_MemcardPath[slot]->GetPath().mb_str()));
+}
 
-	for (u8 i = 0;i < nFiles;i++)
+void CMemcardManager::ResizeColumns(int slot)
+{
+	// Automatic column width
+	for (int i = COLUMN_BANNER; i <= COLUMN_FIRSTBLOCK; i++)
 	{
-		static u32 pxdata[96*32];
-		static u8  animDelay[8];
-		static u32 animData[32*32*8];
-
-		u8 fileIndex = memoryCard[card]->GetFileIndex(i);
-		int numFrames = memoryCard[card]->ReadAnimRGBA8(fileIndex, animData, animDelay);
+		if (mcmSettings.column[i])
+			m_MemcardList[slot]->SetColumnWidth(i, wxLIST_AUTOSIZE);
+		else
+			m_MemcardList[slot]->SetColumnWidth(i, 0);
+	}
+}
 
-		if (!memoryCard[card]->ReadBannerRGBA8(fileIndex, pxdata))
+void CMemcardManager::OnLoaderUpdate(wxCommandEvent& WXUNUSED (event))
+{
+	CMemcardLoader::Result result;
+	while (m_Loader->PopResult(result))
+	{
+		int card = result.slot;
+		if (!m_Loader->IsCurrent(result))
 		{
-			memset(pxdata,0,96*32*4);
-
-			if (numFrames>0) // Just use the first one
-			{
-				u32 *icdata = animData;
-
-				for (int y=0;y<32;y++)
-				{
-					for (int x=0;x<32;x++)
-					{
-						pxdata[y*96+x+32] = icdata[y*32+x];//  | 0xFF000000
-					}
-				}
-			}
+			// the card was closed or replaced while it was loading
+			delete result.memcard;
+			continue;
 		}
 
-		wxBitmap map = wxBitmapFromMemoryRGBA((u8*)pxdata,96,32);
-		images[i*2] = list->Add(map);
-
-		if (numFrames>0)
+		switch (result.type)
 		{
-			memset(pxdata,0,96*32*4);
-			int frames=3;
-			if (numFrames<frames) frames=numFrames;
-			for (int f=0;f<frames;f++)
-			{
-				for (int y=0;y<32;y++)
-				{
-					for (int x=0;x<32;x++)
-					{
-						pxdata[y*96 + x + 32*f] = animData[f*32*32 + y*32 + x];
-					}
-				}
-			}
-			wxBitmap icon = wxBitmapFromMemoryRGBA((u8*)pxdata,96,32);
-			images[i*2+1] = list->Add(icon);
-		}
-	}
-
-	int	pagesMax = (mcmSettings.usePages) ?
-					(page[card] + 1) * itemsPerPage : 128;
-
-	for (j = page[card] * itemsPerPage; (j < nFiles) && (j < pagesMax); j++)
-	{
-		u16 blocks;
-		u16 firstblock;
-		u8 fileIndex = memoryCard[card]->GetFileIndex(j);
-
+		case CMemcardLoader::RESULT_FILES:
+			m_MemcardList[card]->SetFiles(result.files, result.ascii,
+				result.refresh ? &result.changed : NULL);
+			ResizeColumns(card);
+			break;
 
-		int index = m_MemcardList[card]->InsertItem(j, wxEmptyString);
+		case CMemcardLoader::RESULT_IMAGES:
+			m_MemcardList[card]->SetImages(result.row, &result.banner[0],
+				result.icon.empty() ? NULL : &result.icon[0]);
+			break;
 
-		m_MemcardList[card]->SetItem(index, COLUMN_BANNER, wxEmptyString);
+		case CMemcardLoader::RESULT_DONE:
+		{
+			memoryCard[card] = result.memcard;
+			m_MemcardList[card]->SetMemcard(memoryCard[card]);
+			ResizeColumns(card);
+			EnableMemcard(card, true);
 
-		std::string title = memoryCard[card]->GetSaveComment1(fileIndex);
-		std::string comment = memoryCard[card]->GetSaveComment2(fileIndex);
+			wxString wxLabel;
+			wxLabel.Printf(_("%u Free Blocks; %u Free Dir Entries"),
+				memoryCard[card]->GetFreeBlocks(), DIRLEN - memoryCard[card]->GetNumFiles());
+			t_Status[card]->SetLabel(wxLabel);
 
-		bool ascii = memoryCard[card]->IsAsciiEncoding();
-#ifdef _WIN32
-		wxCSConv SJISConv(wxFontMapper::GetEncodingName(wxFONTENCODING_SHIFT_JIS));
-#else
-		wxCSConv SJISConv(wxFontMapper::GetEncodingName(wxFONTENCODING_EUC_JP));
+#ifdef MCM_DEBUG_FRAME
+			if(MemcardManagerDebug == NULL)
+			{
+				MemcardManagerDebug = new CMemcardManagerDebug((wxFrame *)NULL, wxDefaultPosition, wxSize(950, 400));
+			}
+			if (MemcardManagerDebug != NULL)
+			{
+				MemcardManagerDebug->Show();
+				MemcardManagerDebug->updatePanels(memoryCard, card);
+			}
 #endif
-		wxTitle  =  wxString(title.c_str(), ascii ? *wxConvCurrent : SJISConv);
-		wxComment = wxString(comment.c_str(), ascii ? *wxConvCurrent : SJISConv);
-
-		m_MemcardList[card]->SetItem(index, COLUMN_TITLE, wxTitle);
-		m_MemcardList[card]->SetItem(index, COLUMN_COMMENT, wxComment);
-
-		blocks = memoryCard[card]->DEntry_BlockCount(fileIndex);
-		if (blocks == 0xFFFF) blocks = 0;
-		wxBlock.Printf(wxT("%10d"), blocks);
-		m_MemcardList[card]->SetItem(index,COLUMN_BLOCKS, wxBlock);
-		firstblock = memoryCard[card]->DEntry_FirstBlock(fileIndex);
-		//if (firstblock == 0xFFFF) firstblock = 3;	// to make firstblock -1
-		wxFirstBlock.Printf(wxT("%15d"), firstblock);
-		m_MemcardList[card]->SetItem(index, COLUMN_FIRSTBLOCK, wxFirstBlock);
-		m_MemcardList[card]->SetItem(index, COLUMN_ICON, wxEmptyString);
-
-		if (images[j] >= 0)
-		{
-			m_MemcardList[card]->SetItemImage(index, images[j*2]);
-			m_MemcardList[card]->SetItemColumnImage(index, COLUMN_ICON, images[j*2+1]);
+			break;
 		}
-#ifdef DEBUG_MCM
-		m_MemcardList[card]->SetItem(index, COLUMN_GAMECODE, wxString::FromAscii(memoryCard[card]->DEntry_GameCode(fileIndex).c_str()));
-		m_MemcardList[card]->SetItem(index, COLUMN_MAKERCODE, wxString::FromAscii(memoryCard[card]->DEntry_Makercode(fileIndex).c_str()));
-		m_MemcardList[card]->SetItem(index, COLUMN_BIFLAGS, wxString::FromAscii(memoryCard[card]->DEntry_BIFlags(fileIndex).c_str()));
-		m_MemcardList[card]->SetItem(index, COLUMN_FILENAME, wxString::FromAscii(memoryCard[card]->DEntry_FileName(fileIndex).c_str()));
-		m_MemcardList[card]->SetItem(index, COLUMN_MODTIME, wxString::Format(wxT("%04X"), memoryCard[card]->DEntry_ModTime(fileIndex)));
-		m_MemcardList[card]->SetItem(index, COLUMN_IMAGEADD, wxString::Format(wxT("%04X"), memoryCard[card]->DEntry_ImageOffset(fileIndex)));
-		m_MemcardList[card]->SetItem(index, COLUMN_ICONFMT, wxString::FromAscii(memoryCard[card]->DEntry_IconFmt(fileIndex).c_str()));
-		m_MemcardList[card]->SetItem(index, COLUMN_ANIMSPEED, wxString::FromAscii(memoryCard[card]->DEntry_AnimSpeed(fileIndex).c_str()));
-		m_MemcardList[card]->SetItem(index, COLUMN_PERMISSIONS, wxString::FromAscii(memoryCard[card]->DEntry_Permissions(fileIndex).c_str()));
-		m_MemcardList[card]->SetItem(index, COLUMN_COPYCOUNTER, wxString::Format(wxT("%0X"), memoryCard[card]->DEntry_CopyCounter(fileIndex)));
-		m_MemcardList[card]->SetItem(index, COLUMN_COMMENTSADDRESS, wxString::Format(wxT("%04X"), memoryCard[card]->DEntry_CommentsAddress(fileIndex)));
-
-#endif
-	}
 
-	if (mcmSettings.usePages)
-	{
-		if (nFiles <= itemsPerPage)
-		{
-			m_PrevPage[card]->Disable();
-			m_MemcardList[card]->prevPage = false;
-		}
-		if (j == nFiles)
-		{
-			m_NextPage[card]->Disable();
-			m_MemcardList[card]->nextPage = false;
-		}
-		else
-		{
-			m_NextPage[card]->Enable();
-			m_MemcardList[card]->nextPage = true;
+		case CMemcardLoader::RESULT_FAILED:
+			CloseMemcard(card);
+			break;
 		}
 	}
+}
 
-	delete[] images;
-	// Automatic column width and then show the list
-	for (int i = COLUMN_BANNER; i <= COLUMN_FIRSTBLOCK; i++)
-	{
-		if (mcmSettings.column[i])
-			m_MemcardList[card]->SetColumnWidth(i, wxLIST_AUTOSIZE);
-		else
-			m_MemcardList[card]->SetColumnWidth(i, 0);
-	}
-
-	m_MemcardList[card]->Show();
-	wxLabel.Printf(_("%u Free Blocks; %u Free Dir Entries"),
-		memoryCard[card]->GetFreeBlocks(), DIRLEN - nFiles);
-	t_Status[card]->SetLabel(wxLabel);
-
+bool CMemcardManager::AlertFromThread(const char* caption, const char* text, bool yes_no)
+{
+	if (Common::AtomicLoad(m_Closing))
+		return false;
+
+	// caption and text stay valid, this thread waits until OnAlert is done
+	wxCommandEvent event(wxEVT_MEMCARD_ALERT);
+	event.SetString(wxString::FromAscii(text));
+	event.SetClientData((void*)caption);
+	event.SetInt(yes_no);
+	AddPendingEvent(event);
+
+	m_AlertEvent.Wait();
+	return m_AlertResult;
+}
 
-#ifdef MCM_DEBUG_FRAME
-	if(MemcardManagerDebug == NULL)
-	{
-		MemcardManagerDebug = new CMemcardManagerDebug((wxFrame *)NULL, wxDefaultPosition, wxSize(950, 400));
- 
-	}
-	if (MemcardManagerDebug != NULL)
-	{
-		MemcardManagerDebug->Show();
-		MemcardManagerDebug->updatePanels(memoryCard, card);
-	}
-#endif
-	return true;
+void CMemcardManager::OnAlert(wxCommandEvent& event)
+{
+	m_AlertResult = wxYES == wxMessageBox(event.GetString(),
+		wxString::FromAscii((const char*)event.GetClientData()),
+		event.GetInt() ? wxYES_NO : wxOK, this);
+	m_AlertEvent.Set();
 }
 
 void CMemcardManager::CMemcardListCtrl::OnRightClick(wxMouseEvent& event)
@@ -980,7 +900,8 @@ void CMemcardManager::CMemcardListCtrl::OnRightClick(wxMouseEvent& event)
 	long item = HitTest(event.GetPosition(), flags);
 	wxMenu* popupMenu = new wxMenu;
 
-	if (item != wxNOT_FOUND) 
+	// there's nothing to do with a save until its card is done loading
+	if (item != wxNOT_FOUND && m_Memcard)
 	{
 		if (GetItemState(item, wxLIST_STATE_SELECTED) != wxLIST_STATE_SELECTED)
 		{
@@ -994,20 +915,15 @@ void CMemcardManager::CMemcardListCtrl::OnRightClick(wxMouseEvent& event)
 		popupMenu->Append(ID_SAVEIMPORT_A + slot, _("Import Save"));
 		popupMenu->Append(ID_SAVEEXPORT_A + slot, _("Export Save"));
 		popupMenu->Append(ID_EXPORTALL_A + slot, _("Export all saves"));
+		popupMenu->Append(ID_EXPORTTAR_A + slot, _("Export all saves to .tar"));
 				
 		popupMenu->FindItem(ID_COPYFROM_A + slot)->Enable(__mcmSettings.twoCardsLoaded);
 
 		popupMenu->AppendSeparator();
 
 		popupMenu->Append(ID_FIXCHECKSUM_A + slot, _("Fix Checksums"));
-		popupMenu->Append(ID_PREVPAGE_A + slot, _("Previous Page"));
-		popupMenu->Append(ID_NEXTPAGE_A + slot, _("Next Page"));
+		popupMenu->Append(ID_DEFRAG_A + slot, _("Defragment"));
 		popupMenu->Append(ID_MEMCARDPATH_A + slot, wxString::Format(_("Set as default Memcard %c"), 'A' + slot));
-		popupMenu->AppendCheckItem(ID_USEPAGES, _("Enable pages"));
-	
-		popupMenu->FindItem(ID_PREVPAGE_A + slot)->Enable(prevPage && __mcmSettings.usePages);
-		popupMenu->FindItem(ID_NEXTPAGE_A + slot)->Enable(nextPage && __mcmSettings.usePages);
-		popupMenu->FindItem(ID_USEPAGES)->Check(__mcmSettings.usePages);
 		
 		popupMenu->AppendSeparator();
 
@@ -1031,3 +947,174 @@ void CMemcardManager::CMemcardListCtrl::OnRightClick(wxMouseEvent& event)
 	PopupMenu(popupMenu);
 }
 
+void CMemcardManager::CMemcardListCtrl::SetFiles(const std::vector<GCMemcard::FileInfo> &files, bool ascii,
+	const std::vector<u8> *changed)
+{
+	std::vector<Row> oldRows;
+	oldRows.swap(m_Rows);
+
+#ifdef _WIN32
+	wxCSConv SJISConv(wxFontMapper::GetEncodingName(wxFONTENCODING_SHIFT_JIS));
+#else
+	wxCSConv SJISConv(wxFontMapper::GetEncodingName(wxFONTENCODING_EUC_JP));
+#endif
+	m_Rows.resize(files.size());
+	for (size_t i = 0; i < files.size(); ++i)
+	{
+		Row &row = m_Rows[i];
+		row.file = files[i];
+		row.title = wxString(files[i].title.c_str(), ascii ? *wxConvCurrent : SJISConv);
+		row.comment = wxString(files[i].comment.c_str(), ascii ? *wxConvCurrent : SJISConv);
+		row.banner = row.icon = -1;
+	}
+
+	if (changed)
+	{
+		bool sameRows = oldRows.size() == m_Rows.size();
+		int oldRow[DIRLEN];
+		for (u8 i = 0; i < DIRLEN; ++i)
+			oldRow[i] = -1;
+		for (size_t i = 0; i < oldRows.size(); ++i)
+			oldRow[oldRows[i].file.index] = (int)i;
+		for (size_t i = 0; i < changed->size(); ++i)
+			oldRow[(*changed)[i]] = -1;
+
+		for (size_t i = 0; i < m_Rows.size(); ++i)
+		{
+			int j = oldRow[m_Rows[i].file.index];
+			sameRows = sameRows && j == (int)i;
+			if (j >= 0)
+			{
+				m_Rows[i].banner = oldRows[j].banner;
+				m_Rows[i].icon = oldRows[j].icon;
+				oldRows[j].banner = oldRows[j].icon = -1;
+			}
+		}
+		for (size_t i = 0; i < oldRows.size(); ++i)
+		{
+			if (oldRows[i].banner >= 0)
+				m_FreeImages.push_back(oldRows[i].banner);
+			if (oldRows[i].icon >= 0)
+				m_FreeImages.push_back(oldRows[i].icon);
+		}
+
+		if (!sameRows)
+			DeleteAllItems();
+	}
+	else
+	{
+		// drops the selection along with the old rows
+		DeleteAllItems();
+		GetImageList(wxIMAGE_LIST_SMALL)->RemoveAll();
+		m_FreeImages.clear();
+	}
+
+	SetItemCount((long)m_Rows.size());
+	Refresh();
+}
+
+void CMemcardManager::CMemcardListCtrl::SetImages(u32 row, const u32 *banner, const u32 *icon)
+{
+	if (row >= m_Rows.size())
+		return;
+
+	wxBitmap map = wxBitmapFromMemoryRGBA(banner,96,32);
+	m_Rows[row].banner = AddImage(map);
+	if (icon)
+	{
+		wxBitmap iconMap = wxBitmapFromMemoryRGBA(icon,96,32);
+		m_Rows[row].icon = AddImage(iconMap);
+	}
+	RefreshItem(row);
+}
+
+int CMemcardManager::CMemcardListCtrl::AddImage(const wxBitmap &bitmap)
+{
+	wxImageList *list = GetImageList(wxIMAGE_LIST_SMALL);
+	if (m_FreeImages.empty())
+		return list->Add(bitmap);
+
+	int index = m_FreeImages.back();
+	m_FreeImages.pop_back();
+	list->Replace(index, bitmap);
+	return index;
+}
+
+void CMemcardManager::CMemcardListCtrl::SetMemcard(GCMemcard *memcard)
+{
+	m_Memcard = memcard;
+	Refresh();
+}
+
+wxString CMemcardManager::CMemcardListCtrl::OnGetItemText(long item, long column) const
+{
+	if (item < 0 || item >= (long)m_Rows.size())
+		return wxEmptyString;
+
+	const Row &row = m_Rows[item];
+#ifdef DEBUG_MCM
+	u8 fileIndex = row.file.index;
+	if (!m_Memcard && column >= COLUMN_GAMECODE)
+		return wxEmptyString;
+#endif
+	switch (column)
+	{
+	case COLUMN_TITLE:
+		return row.title;
+	case COLUMN_COMMENT:
+		return row.comment;
+	case COLUMN_BLOCKS:
+		return wxString::Format(wxT("%10d"), (row.file.blockCount == 0xFFFF) ? 0 : row.file.blockCount);
+	case COLUMN_FIRSTBLOCK:
+		//if (firstblock == 0xFFFF) firstblock = 3;	// to make firstblock -1
+		return wxString::Format(wxT("%15d"), row.file.firstBlock);
+#ifdef DEBUG_MCM
+	case COLUMN_GAMECODE:
+		return wxString::FromAscii(m_Memcard->DEntry_GameCode(fileIndex).c_str());
+	case COLUMN_MAKERCODE:
+		return wxString::FromAscii(m_Memcard->DEntry_Makercode(fileIndex).c_str());
+	case COLUMN_BIFLAGS:
+		return wxString::FromAscii(m_Memcard->DEntry_BIFlags(fileIndex).c_str());
+	case COLUMN_FILENAME:
+		return wxString::FromAscii(m_Memcard->DEntry_FileName(fileIndex).c_str());
+	case COLUMN_MODTIME:
+		return wxString::Format(wxT("%04X"), m_Memcard->DEntry_ModTime(fileIndex));
+	case COLUMN_IMAGEADD:
+		return wxString::Format(wxT("%04X"), m_Memcard->DEntry_ImageOffset(fileIndex));
+	case COLUMN_ICONFMT:
+		return wxString::FromAscii(m_Memcard->DEntry_IconFmt(fileIndex).c_str());
+	case COLUMN_ANIMSPEED:
+		return wxString::FromAscii(m_Memcard->DEntry_AnimSpeed(fileIndex).c_str());
+	case COLUMN_PERMISSIONS:
+		return wxString::FromAscii(m_Memcard->DEntry_Permissions(fileIndex).c_str());
+	case COLUMN_COPYCOUNTER:
+		return wxString::Format(wxT("%0X"), m_Memcard->DEntry_CopyCounter(fileIndex));
+	case COLUMN_COMMENTSADDRESS:
+		return wxString::Format(wxT("%04X"), m_Memcard->DEntry_CommentsAddress(fileIndex));
+#endif
+	default:
+		return wxEmptyString;
+	}
+}
+
+int CMemcardManager::CMemcardListCtrl::OnGetItemImage(long item) const
+{
+	return OnGetItemColumnImage(item, COLUMN_BANNER);
+}
+
+int CMemcardManager::CMemcardListCtrl::OnGetItemColumnImage(long item, long column) const
+{
+	if (item < 0 || item >= (long)m_Rows.size())
+		return -1;
+
+	// -1 until the loader sent the row's images
+	switch (column)
+	{
+	case COLUMN_BANNER:
+		return m_Rows[item].banner;
+	case COLUMN_ICON:
+		return m_Rows[item].icon;
+	default:
+		return -1;
+	}
+}
@@ -31,6 +31,8 @@
 #include "IniFile.h"
 #include "FileUtil.h"
 #include "MemoryCards/GCMemcard.h"
+#include "MemcardLoader.h"
+#include "MemcardWatcher.h"
 
 #undef MEMCARD_MANAGER_STYLE
 #define MEMCARD_MANAGER_STYLE (wxDEFAULT_FRAME_STYLE | wxNO_FULL_REPAINT_ON_RESIZE)
@@ -40,11 +42,14 @@
 
 #define E_SAVEFAILED "File write failed"
 #define E_UNK "Unknown error"
-#define FIRSTPAGE 0
 
 #ifdef GCNMCMAPP
 #define MEMCMAN_CONFIG_FILE "./MemcardManager.ini"
+#define MEMCMAN_CACHE_FILE "./MemcardManager.cache"
 #endif
+// an alert raised on another thread, see CMemcardManager::AlertFromThread
+DECLARE_EVENT_TYPE(wxEVT_MEMCARD_ALERT, -1)
+
 #ifdef MEMCMAN
 #define DEBUG_MCM
 #define MCM_DEBUG_FRAME
@@ -59,12 +64,13 @@ class CMemcardManager : public wxFrame
 			const wxPoint& pos = wxDefaultPosition, const wxSize& size = wxDefaultSize, long style = MEMCARD_MANAGER_STYLE);
 		virtual ~CMemcardManager();
 
+		// shows an alert raised on a thread other than the GUI thread and
+		// waits for the answer, the message box itself is opened by the GUI thread
+		bool AlertFromThread(const char* caption, const char* text, bool yes_no);
+
 	private:
 		DECLARE_EVENT_TABLE();
 		wxWindow *parent;
-		int page[2],
-			itemsPerPage,
-			maxPages;
 		std::string DefaultMemcard[2],
 					DefaultIOPath;
 		IniFile MemcardManagerIni;
@@ -77,8 +83,6 @@ class CMemcardManager : public wxFrame
 				 *m_SaveImport[2],
 				 *m_SaveExport[2],
 				 *m_Delete[2],
-				 *m_NextPage[2],
-				 *m_PrevPage[2],
 				 *m_ConvertToGci;
 		wxFilePickerCtrl *m_MemcardPath[2];
 		wxStaticText *t_Status[2];
@@ -106,16 +110,15 @@ class CMemcardManager : public wxFrame
 			ID_SAVEIMPORT_B,
 			ID_EXPORTALL_A,
 			ID_EXPORTALL_B,
+			ID_EXPORTTAR_A,
+			ID_EXPORTTAR_B,
+			ID_DEFRAG_A,
+			ID_DEFRAG_B,
 			ID_CONVERTTOGCI,
-			ID_NEXTPAGE_A,
-			ID_NEXTPAGE_B,
-			ID_PREVPAGE_A,
-			ID_PREVPAGE_B,
 			ID_MEMCARDLIST_A,
 			ID_MEMCARDLIST_B,
 			ID_MEMCARDPATH_A,
 			ID_MEMCARDPATH_B,
-			ID_USEPAGES,
 			ID_DUMMY_VALUE_ //don't remove this value unless you have other enum values
 		};
 
@@ -142,29 +145,44 @@ class CMemcardManager : public wxFrame
 		};
 		
 		GCMemcard *memoryCard[2];
+		CMemcardLoader *m_Loader;
+		CMemcardWatcher *m_Watcher;
+
+		// AlertFromThread
+		Common::Event m_AlertEvent;
+		bool m_AlertResult;
+		volatile u32 m_Closing;
 
 		void CreateGUIControls();
 		void CreateMenuBar();
 		void OnClose(wxCloseEvent& event);
 		void CopyDeleteClick(wxCommandEvent& event);
 		void CreateNewMemcard(int slot, wxString path, bool resizeOnly=false);
-		bool ReloadMemcard(const char *fileName, int card);
+		void ReloadMemcard(const char *fileName, int card);
+		void CloseMemcard(int slot);
+		void EnableMemcard(int slot, bool enable);
+		void ResizeColumns(int slot);
+		void OnLoaderUpdate(wxCommandEvent& event);
+		void OnMemcardChanged(wxCommandEvent& event);
+		void OnAlert(wxCommandEvent& event);
 		void TestFunctions(wxCommandEvent& event);
 		void OnMenuChange(wxCommandEvent& event);
-		void OnPageChange(wxCommandEvent& event);
 		void OnPathChange(wxFileDirPickerEvent& event);
 		void ChangePath(int id);
 		bool CopyDeleteSwitch(u32 error, int slot);
+		// one alert for all of ExportAll instead of one per save
+		void ExportAllReport(const GCMemcard::ExportReport &report);
 		bool LoadSettings();
 		bool SaveSettings();
 
 		struct _mcmSettings
 		{
 			bool twoCardsLoaded;
-			bool usePages;
 			bool column[NUMBER_OF_COLUMN + 1];
 		} mcmSettings;
 
+		// a wxLC_VIRTUAL list of the files on a card, the rows are filled in
+		// while CMemcardLoader gets through the card
 		class CMemcardListCtrl : public wxListCtrl
 		{
 //BEGIN_EVENT_TABLE(CMemcardManager::CMemcardListCtrl, wxListCtrl)
@@ -176,6 +194,7 @@ class CMemcardManager : public wxFrame
 				long style, _mcmSettings& _mcmSetngs)
 				: wxListCtrl(parent, id, pos, size, style)
 				, __mcmSettings(_mcmSetngs)
+				, m_Memcard(NULL)
 			{
 				Connect(wxEVT_RIGHT_DOWN, wxMouseEventHandler(
 					CMemcardListCtrl::OnRightClick));
@@ -186,10 +205,36 @@ class CMemcardManager : public wxFrame
 					CMemcardListCtrl::OnRightClick));
 			}
 			_mcmSettings & __mcmSettings;
-			bool prevPage,
-				 nextPage;
+
+			// lists files without images, an empty list clears it. With changed
+			// (see CMemcardLoader::Result) the other files keep their images,
+			// and the selection if no row moved
+			void SetFiles(const std::vector<GCMemcard::FileInfo> &files, bool ascii,
+				const std::vector<u8> *changed = NULL);
+			// 96x32 RGBA images of a row, icon can be NULL
+			void SetImages(u32 row, const u32 *banner, const u32 *icon);
+			// the card the debug columns read from, NULL while it's loading
+			void SetMemcard(GCMemcard *memcard);
 		private:
-			void OnRightClick(wxMouseEvent& event);	
+			struct Row
+			{
+				GCMemcard::FileInfo file;
+				wxString title,
+						 comment;
+				int banner,		// image list indices, -1 for none
+					icon;
+			};
+
+			void OnRightClick(wxMouseEvent& event);
+			int AddImage(const wxBitmap &bitmap);
+			virtual wxString OnGetItemText(long item, long column) const;
+			virtual int OnGetItemImage(long item) const;
+			virtual int OnGetItemColumnImage(long item, long column) const;
+
+			GCMemcard *m_Memcard;
+			std::vector<Row> m_Rows;
+			// image list entries no row uses anymore, replaced before anything is added
+			std::vector<int> m_FreeImages;
 		};
 		
 		CMemcardListCtrl *m_MemcardList[2];
@@ -111,7 +111,7 @@ void CMemcardSelectPanel::CreateGUIControls()
 
 	MemcardPath = new wxFilePickerCtrl(this, wxID_ANY,
 			 wxString::From8BitData(File::GetUserPath(D_GCUSER_IDX).c_str()), _("Save memory card as..."),
-		_("Gamecube Memory Cards (*.raw,*.gcp,*.mci)") + wxString(wxT("|*.raw;*.gcp;*.mci")), wxDefaultPosition, wxDefaultSize, wxFLP_USE_TEXTCTRL|wxFLP_SAVE);
+		_("Gamecube Memory Cards (*.raw,*.gcp,*.mci,*.mcz)") + wxString(wxT("|*.raw;*.gcp;*.mci;*.mcz")), wxDefaultPosition, wxDefaultSize, wxFLP_USE_TEXTCTRL|wxFLP_SAVE);
 	
 	wxBoxSizer * const memcardSettingsSizer = new wxBoxSizer(wxHORIZONTAL);
 	wxBoxSizer * const choiceSizer = new wxBoxSizer(wxHORIZONTAL);
@@ -0,0 +1,192 @@
+// Copyright (C) 2003 Dolphin Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official SVN repository and contact information can be found at
+// http://code.google.com/p/dolphin-emu/
+
+#include "MemcardWatcher.h"
+#include "Atomic.h"
+#include "FileUtil.h"
+#include "StringUtil.h"
+#include "Timer.h"
+#include "MemoryCards/GCMemcard.h"
+
+#ifdef __linux__
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+DEFINE_EVENT_TYPE(wxEVT_MEMCARD_CHANGED)
+
+CMemcardWatcher::CMemcardWatcher(wxEvtHandler *handler)
+	: m_handler(handler)
+	, m_inotify(-1)
+	, m_quit(0)
+{
+	for (int slot = SLOT_A; slot <= SLOT_B; ++slot)
+	{
+		m_files[slot].wd = -1;
+		m_files[slot].modTime = m_files[slot].size = 0;
+		m_files[slot].changed = false;
+		m_files[slot].changedTime = 0;
+	}
+#ifdef __linux__
+	m_inotify = inotify_init();
+#endif
+	m_thread = std::thread(&CMemcardWatcher::WorkerThread, this);
+}
+
+CMemcardWatcher::~CMemcardWatcher()
+{
+	Common::AtomicStore(m_quit, 1);
+	m_thread.join();
+#ifdef __linux__
+	if (m_inotify >= 0)
+		close(m_inotify);
+#endif
+}
+
+void CMemcardWatcher::Watch(int slot, const std::string &fileName)
+{
+	std::lock_guard<std::mutex> lk(m_lock);
+	WatchedFile &file = m_files[slot];
+
+#ifdef __linux__
+	// both cards may be in the same directory, inotify hands out one
+	// watch per directory
+	WatchedFile &other = m_files[slot ^ 1];
+	if (file.wd >= 0 && file.wd != other.wd)
+		inotify_rm_watch(m_inotify, file.wd);
+#endif
+	file.fileName = fileName;
+	file.wd = -1;
+	file.changed = false;
+	if (fileName.empty())
+		return;
+
+	std::string path, name, extension;
+	SplitPath(fileName, &path, &name, &extension);
+	file.name = name + extension;
+#ifdef __linux__
+	if (m_inotify >= 0)
+		file.wd = inotify_add_watch(m_inotify, path.empty() ? "." : path.c_str(),
+			IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO);
+#endif
+	file.modTime = File::GetModTime(fileName);
+	file.size = File::GetSize(fileName);
+}
+
+void CMemcardWatcher::WorkerThread(CMemcardWatcher *watcher)
+{
+	Common::SetCurrentThreadName("Memcard watcher");
+
+	u32 lastPoll = Common::Timer::GetTimeMs();
+	while (!Common::AtomicLoad(watcher->m_quit))
+	{
+		watcher->WaitForEvents();
+
+		u32 now = Common::Timer::GetTimeMs();
+		if (now - lastPoll >= POLL_INTERVAL_MS)
+		{
+			watcher->PollFiles(now);
+			lastPoll = now;
+		}
+		watcher->ReportChanges(now);
+	}
+}
+
+void CMemcardWatcher::WaitForEvents()
+{
+#ifdef __linux__
+	if (m_inotify >= 0)
+	{
+		pollfd fd;
+		fd.fd = m_inotify;
+		fd.events = POLLIN;
+		if (poll(&fd, 1, WAIT_MS) <= 0)
+			return;
+
+		char buffer[4096] __attribute__((aligned(__alignof__(inotify_event))));
+		ssize_t length = read(m_inotify, buffer, sizeof(buffer));
+		if (length <= 0)
+			return;
+
+		u32 now = Common::Timer::GetTimeMs();
+		std::lock_guard<std::mutex> lk(m_lock);
+		for (char *p = buffer; p < buffer + length; p += sizeof(inotify_event) + ((inotify_event*)p)->len)
+		{
+			const inotify_event *event = (const inotify_event*)p;
+			for (int slot = SLOT_A; slot <= SLOT_B; ++slot)
+			{
+				WatchedFile &file = m_files[slot];
+				// events were dropped, anything may have changed
+				if (event->mask & IN_Q_OVERFLOW)
+				{
+					if (!file.fileName.empty())
+						SetChanged(file, now);
+				}
+				else if (file.wd >= 0 && event->wd == file.wd && event->len && file.name == event->name)
+				{
+					SetChanged(file, now);
+				}
+			}
+		}
+		return;
+	}
+#endif
+	Common::SleepCurrentThread(WAIT_MS);
+}
+
+void CMemcardWatcher::PollFiles(u32 now)
+{
+	std::lock_guard<std::mutex> lk(m_lock);
+	for (int slot = SLOT_A; slot <= SLOT_B; ++slot)
+	{
+		WatchedFile &file = m_files[slot];
+		if (file.fileName.empty() || file.wd >= 0)
+			continue;
+
+		u64 modTime = File::GetModTime(file.fileName);
+		u64 size = File::GetSize(file.fileName);
+		if (modTime != file.modTime || size != file.size)
+		{
+			file.modTime = modTime;
+			file.size = size;
+			SetChanged(file, now);
+		}
+	}
+}
+
+void CMemcardWatcher::ReportChanges(u32 now)
+{
+	std::lock_guard<std::mutex> lk(m_lock);
+	for (int slot = SLOT_A; slot <= SLOT_B; ++slot)
+	{
+		WatchedFile &file = m_files[slot];
+		if (file.changed && now - file.changedTime >= SETTLE_MS)
+		{
+			file.changed = false;
+			wxCommandEvent event(wxEVT_MEMCARD_CHANGED);
+			event.SetInt(slot);
+			m_handler->AddPendingEvent(event);
+		}
+	}
+}
+
+void CMemcardWatcher::SetChanged(WatchedFile &file, u32 now)
+{
+	file.changed = true;
+	file.changedTime = now;
+}
@@ -0,0 +1,82 @@
+// Copyright (C) 2003 Dolphin Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official SVN repository and contact information can be found at
+// http://code.google.com/p/dolphin-emu/
+
+#ifndef __MEMCARD_WATCHER_h__
+#define __MEMCARD_WATCHER_h__
+
+#include <string>
+
+#include <wx/wx.h>
+
+#include "Common.h"
+#include "Thread.h"
+
+// sent to the handler when a watched card file was written, GetInt() is the slot
+DECLARE_EVENT_TYPE(wxEVT_MEMCARD_CHANGED, -1)
+
+// Watches the files of the open cards for writes by other programs, like
+// an emulator that has the card inserted. Uses inotify on the card's
+// directory on linux, anything else (or a directory inotify can't watch)
+// compares the file's modification time and size once a second.
+//
+// A change is only reported once the file was left alone for a moment,
+// a card is usually written in several steps.
+class CMemcardWatcher : NonCopyable
+{
+public:
+	CMemcardWatcher(wxEvtHandler *handler);
+	~CMemcardWatcher();
+
+	// starts watching fileName for slot, an empty fileName stops watching
+	void Watch(int slot, const std::string &fileName);
+
+private:
+	enum
+	{
+		WAIT_MS = 100,			// longest the worker sleeps before checking m_quit
+		POLL_INTERVAL_MS = 1000,
+		SETTLE_MS = 300,		// quiet time before a change is reported
+	};
+
+	struct WatchedFile
+	{
+		std::string fileName;
+		std::string name;	// without the directory, for the inotify events
+		int wd;				// inotify watch of the file's directory, -1 to poll instead
+		u64 modTime, size;	// as of the last poll
+		bool changed;		// not reported yet
+		u32 changedTime;	// Timer::GetTimeMs of the last write
+	};
+
+	static void WorkerThread(CMemcardWatcher *watcher);
+	void WaitForEvents();
+	void PollFiles(u32 now);
+	void ReportChanges(u32 now);
+	void SetChanged(WatchedFile &file, u32 now);
+
+	wxEvtHandler *m_handler;
+
+	// m_files is shared by Watch and the worker
+	std::mutex m_lock;
+	WatchedFile m_files[2];
+	int m_inotify;	// -1 if there is no inotify
+
+	volatile u32 m_quit;
+	std::thread m_thread;
+};
+
+#endif
@@ -14,9 +14,28 @@
 
 // Official SVN repository and contact information can be found at
 // http://code.google.com/p/dolphin-emu/
+#include <algorithm>
+
 #include "GCMemcard.h"
 #include "ColorUtil.h"
+#include "CPUDetect.h"
 #include "FileUtil.h"
+#include "FileSearch.h"
+#include "Hash.h"
+#include "Thread.h"
+#include "Timer.h"
+
+// SSE2 is always there on x86, AVX2 only when cpu_info reports it
+#if defined(_M_X64) || defined(_M_IX86)
+#include <emmintrin.h>
+#define GCMEMCARD_SSE2
+// keep in sync with GCMemcardAVX2.cpp
+#if (defined(_MSC_VER) && _MSC_VER >= 1700) || defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+#define GCMEMCARD_AVX2
+// GCMemcardAVX2.cpp
+u16 SumBE16_AVX2(const u16 *buf, u32 length);
+#endif
+#endif
 
 void ByteSwap(u8 *valueA, u8 *valueB)
 {
@@ -25,60 +44,36 @@ void ByteSwap(u8 *valueA, u8 *valueB)
 	*valueB = tmp;
 }
 
-void decode5A3image(u32* dst, u16* src, int width, int height)
-{
-	for (int y = 0; y < height; y += 4)
-	{
-		for (int x = 0; x < width; x += 4)
-		{
-			for (int iy = 0; iy < 4; iy++, src += 4)
-			{
-				for (int ix = 0; ix < 4; ix++)
-				{
-					u32 RGBA = ColorUtil::Decode5A3(Common::swap16(src[ix]));
-					dst[(y + iy) * width + (x + ix)] = RGBA;
-				}
-			}
-		}
-	}
-}
-
-void decodeCI8image(u32* dst, u8* src, u16* pal, int width, int height)
-{
-	for (int y = 0; y < height; y += 4)
-	{
-		for (int x = 0; x < width; x += 8)
-		{
-			for (int iy = 0; iy < 4; iy++, src += 8)
-			{
-				u32 *tdst = dst+(y+iy)*width+x;
-				for (int ix = 0; ix < 8; ix++)
-				{
-					// huh, this seems wrong. CI8, not 5A3, no?
-					tdst[ix] = ColorUtil::Decode5A3(Common::swap16(pal[src[ix]]));
-				}
-			}
-		}
-	}
-}
-
-GCMemcard::GCMemcard(const char *filename, bool forceCreation, bool sjis, u16 _sizeMb)
+GCMemcard::GCMemcard(const char *filename, bool forceCreation, bool sjis, u16 _sizeMb, u8 loadMode)
 	: m_valid(false)
+	, m_loadResult(NOMEMCARD)
+	, m_loadChecksums(0)
+	, m_restoredOlderDir(false)
+	, m_testedChecksums(0)
+	, m_checksumResults(0)
 	, mci_offset(0)
 	, m_fileName(filename)
+	, m_loadMode(LOAD_FULL)
+	, m_mappedBlocks(NULL)
+	, m_lazyFileOffset(0)
 { 
+	m_loadResult = Load(forceCreation, sjis, _sizeMb, loadMode);
+}
+
+u32 GCMemcard::Load(bool forceCreation, bool sjis, u16 _sizeMb, u8 loadMode)
+{
+	const char *filename = m_fileName.c_str();
 	File::IOFile mcdFile(m_fileName, "r+b");
 	if (!mcdFile.IsOpen())
 	{
 		if (!forceCreation && !AskYesNoT("\"%s\" does not exist.\n Create a new %d-block Memcard?", filename, (_sizeMb*MBIT_TO_BLOCKS)-MC_FST_BLOCKS))
 		{
-			return;
+			return OPENFAIL;
 		}
 		
 		m_valid = Format(forceCreation ? sjis : !AskYesNoT("Format as ascii (NTSC\\PAL)?\nChoose no for sjis (NTSC-J)"), _sizeMb);
-		void SetupCurrentDirBat();
 		
-		return;
+		return m_valid ? SUCCESS : WRITEFAIL;
 	}
 	else
 	{
@@ -89,21 +84,30 @@ GCMemcard::GCMemcard(const char *filename, bool forceCreation, bool sjis, u16 _s
 		{
 			mci_offset = MCI_HDR_SIZE;
 		}
+		else if (GCMemcardCompressed::IsCompressedName(m_fileName))
+		{
+			if (!m_compressedFile.Open(m_fileName))
+			{
+				PanicAlertT("%s failed to load as a compressed memory card\n File has an invalid header or index", filename);
+				return INVALIDHEADER;
+			}
+		}
 		else if (strcasecmp(fileType.c_str(), ".raw") && strcasecmp(fileType.c_str(), ".gcp"))
 		{
-			PanicAlertT("File has the extension \"%s\"\nvalid extensions are (.raw/.gcp)", fileType.c_str());
-			return;
+			PanicAlertT("File has the extension \"%s\"\nvalid extensions are (.raw/.gcp/.mci/.mcz)", fileType.c_str());
+			return INVALIDEXTENSION;
 		}
-		u32 size = (u32)mcdFile.GetSize() - mci_offset;
+		u32 size = m_compressedFile.IsOpen() ? m_compressedFile.GetNumBlocks() * BLOCK_SIZE :
+			(u32)mcdFile.GetSize() - mci_offset;
 		if (size < MC_FST_BLOCKS*BLOCK_SIZE)
 		{
 			PanicAlertT("%s failed to load as a memorycard \nfile is not large enough to be a valid memory card file (0x%x bytes)", filename, size);
-			return;
+			return INVALIDFILESIZE;
 		}
 		if (size % BLOCK_SIZE)
 		{
 			PanicAlertT("%s failed to load as a memorycard \n Card file size is invalid (0x%x bytes)", filename, size);
-				return;
+				return INVALIDFILESIZE;
 		}
 
 		m_sizeMb = (u16)(size/BLOCK_SIZE) / MBIT_TO_BLOCKS;
@@ -118,7 +122,7 @@ GCMemcard::GCMemcard(const char *filename, bool forceCreation, bool sjis, u16 _s
 				break;
 			default:
 				PanicAlertT("%s failed to load as a memorycard \n Card size is invalid (0x%x bytes)", filename, size);
-				return;
+				return INVALIDFILESIZE;
 		}
 		if  (mci_offset)
 		{
@@ -128,7 +132,7 @@ GCMemcard::GCMemcard(const char *filename, bool forceCreation, bool sjis, u16 _s
 			if (!ValidMCIHeader())
 			{
 				PanicAlertT("%s failed to load as a mci memory card image\n File has an invalid mci header", filename);
-				return;
+				return INVALIDHEADER;
 			}
 			
 		}
@@ -137,107 +141,189 @@ GCMemcard::GCMemcard(const char *filename, bool forceCreation, bool sjis, u16 _s
 	
 
 	mcdFile.Seek(mci_offset, SEEK_SET);
-	if (!mcdFile.ReadBytes(&hdr, BLOCK_SIZE))
+	if (!ReadSystemBlock(mcdFile, HDR_BLOCK, &hdr))
 	{
 		PanicAlertT("Failed to read header correctly\n(0x0000-0x1FFF)");
-		return;
+		return READFAIL;
 	}
 	if (m_sizeMb != BE16(hdr.SizeMb))
 	{
 		PanicAlertT("Memorycard filesize does not match the header size");
-		return;
+		return INVALIDFILESIZE;
 	}
 
-	if (!mcdFile.ReadBytes(&dir, BLOCK_SIZE))
+	if (!ReadSystemBlock(mcdFile, DIR_BLOCK, &dir))
 	{
 		PanicAlertT("Failed to read directory correctly\n(0x2000-0x3FFF)");
-		return;
+		return READFAIL;
 	}
 
-	if (!mcdFile.ReadBytes(&dir_backup, BLOCK_SIZE))
+	if (!ReadSystemBlock(mcdFile, DIR_BACKUP_BLOCK, &dir_backup))
 	{
 		PanicAlertT("Failed to read directory backup correctly\n(0x4000-0x5FFF)");
-		return;
+		return READFAIL;
 	}
 
-	if (!mcdFile.ReadBytes(&bat, BLOCK_SIZE))
+	if (!ReadSystemBlock(mcdFile, BAT_BLOCK, &bat))
 	{
 		PanicAlertT("Failed to read block allocation table correctly\n(0x6000-0x7FFF)");
-		return;
+		return READFAIL;
 	}
 
-	if (!mcdFile.ReadBytes(&bat_backup, BLOCK_SIZE))
+	if (!ReadSystemBlock(mcdFile, BAT_BACKUP_BLOCK, &bat_backup))
 	{
 		PanicAlertT("Failed to read block allocation table backup correctly\n(0x8000-0x9FFF)");
-		return;
+		return READFAIL;
 	}
 
+	maxBlock = m_sizeMb * MBIT_TO_BLOCKS;
+	m_dirtyBlocks.assign(maxBlock, false);
+	m_syncedFileName = m_fileName;
+
+	m_testedChecksums = 0;
 	u32 csums = TestChecksums();
+	m_loadChecksums = csums;
 	
 	if (csums & 0x1)
 	{
 		// header checksum error!
 		// invalid files do not always get here
 		PanicAlertT("Header checksum failed");
-		return;
+		return CHECKSUMFAIL;
+	}
+
+	if ((csums & 0x2) && (csums & 0x4))
+	{
+		// both directories are wrong!
+		PanicAlertT("Directory checksum failed\n and Directory backup checksum failed");
+		return CHECKSUMFAIL;
+	}
+
+	if ((csums & 0x8) && (csums & 0x10))
+	{
+		// both BATs are wrong!
+		PanicAlertT("Block Allocation Table checksum failed");
+		return CHECKSUMFAIL;
 	}
 
-	if (csums & 0x2) // directory checksum error!
+	// A save that was interrupted leaves one directory or BAT torn, whichever
+	// copy it was writing. The current copies are only picked among the good
+	// ones, by going back to the directory and BAT from before that update.
+	// Saves write the directory before the BAT:
+	if (csums & (0x2 | 0x4))
 	{
-		if (csums & 0x4)
+		// the update never reached its BAT, the newer BAT is still current
+		if (csums & 0x2)
 		{
-			// backup is also wrong!
-			PanicAlertT("Directory checksum failed\n and Directory backup checksum failed");
-			return;
+			dir = dir_backup;
+			MarkDirty(DIR_BLOCK);
 		}
 		else
 		{
-			// backup is correct, restore
+			dir_backup = dir;
+			MarkDirty(DIR_BACKUP_BLOCK);
+		}
+	}
+	else if ((csums & (0x8 | 0x10)) &&
+		!CheckDirBat((BE16(dir.UpdateCounter) > BE16(dir_backup.UpdateCounter)) ? dir : dir_backup,
+			(csums & 0x8) ? bat_backup : bat, NULL))
+	{
+		// the update already wrote its directory, that is the newer one.
+		// If the newer one agrees with the good BAT, the broken BAT wasn't
+		// what the last update wrote, or that update left the BAT as it was
+		if (BE16(dir.UpdateCounter) > BE16(dir_backup.UpdateCounter))
+		{
 			dir = dir_backup;
-			bat = bat_backup;
-
-			// update checksums
-			csums = TestChecksums();
+			MarkDirty(DIR_BLOCK);
+		}
+		else
+		{
+			dir_backup = dir;
+			MarkDirty(DIR_BACKUP_BLOCK);
 		}
 	}
 
-	if (csums & 0x8) // BAT checksum error!
+	if (csums & 0x8)
+	{
+		bat = bat_backup;
+		MarkDirty(BAT_BLOCK);
+	}
+	else if (csums & 0x10)
 	{
-		if (csums & 0x10)
+		bat_backup = bat;
+		MarkDirty(BAT_BACKUP_BLOCK);
+	}
+
+	// A save that stopped between the directory and the BAT has good checksums
+	// everywhere, but the directory is one update ahead of the BAT. Go back to
+	// the directory from before that update as well
+	m_restoredOlderDir = DirAheadOfBat();
+	if (m_restoredOlderDir)
+	{
+		if (BE16(dir.UpdateCounter) > BE16(dir_backup.UpdateCounter))
 		{
-			// backup is also wrong!
-			PanicAlertT("Block Allocation Table checksum failed");
-			return;
+			dir = dir_backup;
+			MarkDirty(DIR_BLOCK);
 		}
 		else
 		{
-			// backup is correct, restore
-			dir = dir_backup;
-			bat = bat_backup;
+			dir_backup = dir;
+			MarkDirty(DIR_BACKUP_BLOCK);
+		}
+	}
+
+	if (csums & (0x2 | 0x4 | 0x8 | 0x10))
+	{
+		// update checksums
+		csums = TestChecksums();
+	}
+
+	// a .mcz can only be read a block at a time
+	if (m_compressedFile.IsOpen() && loadMode == LOAD_MMAP)
+		loadMode = LOAD_LAZY;
 
-			// update checksums
-			csums = TestChecksums();
+	if (loadMode == LOAD_MMAP && m_mappedFile.Open(m_fileName))
+	{
+		if (m_mappedFile.GetSize() >= (u64)mci_offset + maxBlock * BLOCK_SIZE)
+		{
+			// Data blocks are only paged in when they are read, and
+			// only copied when they are modified
+			m_loadMode = LOAD_MMAP;
+			m_backingFileName = m_fileName;
+			m_mappedBlocks = (GCMBlock*)(m_mappedFile.GetData() + mci_offset + MC_FST_BLOCK_SIZE);
+			m_valid = true;
+
+			mcdFile.Close();
+			SetCurrentDirBatInternal();
+			return SUCCESS;
 		}
-// It seems that the backup having a larger counter doesn't necessarily mean
-// the backup should be copied?
-//	}
-//
-//	if(BE16(dir_backup.UpdateCounter) > BE16(dir.UpdateCounter)) //check if the backup is newer
-//	{
-//		dir = dir_backup;
-//		bat = bat_backup; // needed?
+		m_mappedFile.Close();
+	}
+
+	if (loadMode == LOAD_LAZY)
+	{
+		// Only the system blocks have been read, keep the file open for the rest
+		m_loadMode = LOAD_LAZY;
+		m_backingFileName = m_fileName;
+		m_lazyBlocks.assign(maxBlock - MC_FST_BLOCKS, NULL);
+		if (!m_compressedFile.IsOpen())
+			m_lazyFile.SetHandle(mcdFile.ReleaseHandle());
+		// SaveAs may change mci_offset, the file keeps its own
+		m_lazyFileOffset = mci_offset;
+		m_valid = true;
+
+		SetCurrentDirBatInternal();
+		return SUCCESS;
 	}
 
 	mcdFile.Seek(mci_offset + MC_FST_BLOCK_SIZE, SEEK_SET);
-	
-	maxBlock = m_sizeMb * MBIT_TO_BLOCKS;
 	mc_data_blocks.reserve(maxBlock - MC_FST_BLOCKS);
 
 	m_valid = true;
 	for (u16 i = MC_FST_BLOCKS; i < maxBlock; ++i)
 	{
 		GCMBlock b;
-		if (mcdFile.ReadBytes(b.block, BLOCK_SIZE))
+		if (m_compressedFile.IsOpen() ? m_compressedFile.ReadBlock(i, b.block) : mcdFile.ReadBytes(b.block, BLOCK_SIZE))
 		{
 			mc_data_blocks.push_back(b);
 		}
@@ -250,8 +336,28 @@ GCMemcard::GCMemcard(const char *filename, bool forceCreation, bool sjis, u16 _s
 	}
 
 	mcdFile.Close();
+	m_compressedFile.Close();
 
 	SetCurrentDirBatInternal();
+	return m_valid ? SUCCESS : READFAIL;
+}
+
+bool GCMemcard::DirAheadOfBat() const
+{
+	const bool dirNewer = BE16(dir.UpdateCounter) > BE16(dir_backup.UpdateCounter);
+	const Directory &newDir = dirNewer ? dir : dir_backup;
+	const Directory &oldDir = dirNewer ? dir_backup : dir;
+	const BlockAlloc &newBat = (BE16(bat.UpdateCounter) > BE16(bat_backup.UpdateCounter)) ? bat : bat_backup;
+
+	// cards that never agreed are left as they are
+	return !CheckDirBat(newDir, newBat, NULL) && CheckDirBat(oldDir, newBat, NULL);
+}
+
+bool GCMemcard::ReadSystemBlock(File::IOFile &mcdFile, u16 block, void *dest)
+{
+	if (m_compressedFile.IsOpen())
+		return m_compressedFile.ReadBlock(block, (u8*)dest);
+	return mcdFile.ReadBytes(dest, BLOCK_SIZE);
 }
 
 void GCMemcard::SetCurrentDirBatInternal()
@@ -276,6 +382,8 @@ void GCMemcard::SetCurrentDirBatInternal()
 		CurrentBat = &bat_backup;
 		PreviousBat = &bat;
 	}
+	m_freeBlocks.Rebuild(*CurrentBat, maxBlock);
+	m_dirIndex.Rebuild(*CurrentDir);
 }
 
 bool GCMemcard::ValidMCIHeader()
@@ -294,7 +402,10 @@ void GCMemcard::SetMCIHeader()
 {
 	memset(&mci_hdr, 0, MCI_HDR_SIZE);
 	memcpy(mci_hdr.version, "SDMC01", 6);
-	snprintf(mci_hdr.blocks, 8, "%04ld-BLK", maxBlock);
+	// blocks isn't null terminated, the zeros of pad2 follow it
+	char block_str[9];
+	sprintf(block_str, "%04ld-BLK", maxBlock);
+	memcpy(mci_hdr.blocks, block_str, sizeof(mci_hdr.blocks));
 	mci_hdr.size = BE16(maxBlock);
 	mci_hdr.unknown = 0xF4;
 }
@@ -304,27 +415,360 @@ bool GCMemcard::IsAsciiEncoding() const
 	return hdr.Encoding == 0;
 }
 
-bool GCMemcard::Save()
+GCMemcard::~GCMemcard()
 {
-	File::IOFile mcdFile(m_fileName, "wb");
-	
-	if (mci_offset)
+	ReleaseBackingFile(false);
+}
+
+const GCMemcard::GCMBlock& GCMemcard::GetDataBlock(u16 block) const
+{
+	if (m_mappedBlocks)
+		return m_mappedBlocks[block - MC_FST_BLOCKS];
+	if (m_loadMode == LOAD_LAZY)
+	{
+		if (!m_lazyBlocks[block - MC_FST_BLOCKS])
+			LoadDataBlock(block);
+		return *m_lazyBlocks[block - MC_FST_BLOCKS];
+	}
+	return mc_data_blocks[block - MC_FST_BLOCKS];
+}
+
+GCMemcard::GCMBlock& GCMemcard::GetDataBlockForWrite(u16 block)
+{
+	MarkDirty(block);
+
+	// the mapping is private, the first write to a page copies it
+	if (m_mappedBlocks)
+		return m_mappedBlocks[block - MC_FST_BLOCKS];
+	if (m_loadMode == LOAD_LAZY)
 	{
-		mcdFile.WriteBytes(&mci_hdr, MCI_HDR_SIZE);
+		if (!m_lazyBlocks[block - MC_FST_BLOCKS])
+			LoadDataBlock(block);
+		return *m_lazyBlocks[block - MC_FST_BLOCKS];
 	}
+	return mc_data_blocks[block - MC_FST_BLOCKS];
+}
+
+void GCMemcard::LoadDataBlock(u16 block) const
+{
+	GCMBlock *b = new GCMBlock;
+	if (m_compressedFile.IsOpen())
+	{
+		if (!m_compressedFile.ReadBlock(block, b->block))
+		{
+			PanicAlertT("Failed to read block %d of the save data\nThe compressed block is damaged", block);
+			b->erase();
+		}
+	}
+	else if (!m_lazyFile.Seek(m_lazyFileOffset + block * BLOCK_SIZE, SEEK_SET) || !m_lazyFile.ReadBytes(b->block, BLOCK_SIZE))
+	{
+		PanicAlertT("Failed to read block %d of the save data\nMemcard may be truncated\nFilePosition:%llx", block, m_lazyFile.Tell());
+		// a failed read may have filled part of the block
+		b->erase();
+		m_lazyFile.Clear();
+	}
+	m_lazyBlocks[block - MC_FST_BLOCKS] = b;
+}
+
+void GCMemcard::ReleaseBackingFile(bool copyBlocks)
+{
+	if (m_loadMode == LOAD_FULL)
+		return;
+
+	if (copyBlocks)
+	{
+		mc_data_blocks.clear();
+		mc_data_blocks.reserve(maxBlock - MC_FST_BLOCKS);
+		for (u16 i = MC_FST_BLOCKS; i < maxBlock; ++i)
+			mc_data_blocks.push_back(GetDataBlock(i));
+	}
+
+	m_mappedBlocks = NULL;
+	m_mappedFile.Close();
+	for (u32 i = 0; i < m_lazyBlocks.size(); ++i)
+		delete m_lazyBlocks[i];
+	m_lazyBlocks.clear();
+	m_lazyFile.Close();
+	m_compressedFile.Close();
+	m_backingFileName.clear();
+	m_loadMode = LOAD_FULL;
+}
+
+u32 GCMemcard::ReloadSystemBlocks(std::vector<u8> &changed)
+{
+	changed.clear();
+	if (!m_valid || m_loadMode != LOAD_LAZY || m_compressedFile.IsOpen() || m_backingFileName != m_fileName ||
+		m_syncedFileName != m_fileName || m_lazyFileOffset != mci_offset)
+		return FAIL;
+	for (u16 i = 0; i < maxBlock; ++i)
+		if (m_dirtyBlocks[i])
+			return FAIL;
+
+	// the writer may have replaced the file instead of writing into it,
+	// the handle from Load would still read the old one
+	File::IOFile mcdFile(m_fileName, "r+b");
+	if (!mcdFile.IsOpen())
+		return OPENFAIL;
+	if (mcdFile.GetSize() != (u64)mci_offset + maxBlock * BLOCK_SIZE)
+		return INVALIDFILESIZE;
+
+	const Header oldHdr = hdr;
+	const Directory oldDir = dir, oldDirBackup = dir_backup;
+	const BlockAlloc oldBat = bat, oldBatBackup = bat_backup;
+	const Directory oldCurrentDir = *CurrentDir;
+
+	// no alerts here, a card that needs them is loaded again by the caller
+	u32 result = SUCCESS;
 	mcdFile.Seek(mci_offset, SEEK_SET);
+	if (!mcdFile.ReadBytes(&hdr, BLOCK_SIZE) || !mcdFile.ReadBytes(&dir, BLOCK_SIZE) ||
+		!mcdFile.ReadBytes(&dir_backup, BLOCK_SIZE) || !mcdFile.ReadBytes(&bat, BLOCK_SIZE) ||
+		!mcdFile.ReadBytes(&bat_backup, BLOCK_SIZE))
+	{
+		result = READFAIL;
+	}
+	else if (m_sizeMb != BE16(hdr.SizeMb))
+	{
+		result = INVALIDFILESIZE;
+	}
+	else
+	{
+		// Load would go back to the good copies of a torn directory or BAT, or
+		// to the older directory, which leaves dirty blocks behind
+		m_testedChecksums = 0;
+		u32 csums = TestChecksums();
+		if ((csums & (0x1 | 0x2 | 0x4 | 0x8 | 0x10)) || DirAheadOfBat())
+		{
+			result = CHECKSUMFAIL;
+		}
+		else
+		{
+			m_loadChecksums = csums;
+			m_restoredOlderDir = false;
+		}
+	}
+
+	if (result != SUCCESS)
+	{
+		hdr = oldHdr;
+		dir = oldDir;
+		dir_backup = oldDirBackup;
+		bat = oldBat;
+		bat_backup = oldBatBackup;
+		m_testedChecksums = 0;
+		return result;
+	}
+
+	for (u32 i = 0; i < m_lazyBlocks.size(); ++i)
+		delete m_lazyBlocks[i];
+	m_lazyBlocks.assign(maxBlock - MC_FST_BLOCKS, NULL);
+	m_lazyFile.SetHandle(mcdFile.ReleaseHandle());
+
+	SetCurrentDirBatInternal();
+	for (u8 i = 0; i < DIRLEN; ++i)
+		if (memcmp(&oldCurrentDir.Dir[i], &CurrentDir->Dir[i], DENTRY_SIZE))
+			changed.push_back(i);
+	return SUCCESS;
+}
+
+const void* GCMemcard::GetSystemBlock(u16 block) const
+{
+	switch (block)
+	{
+		case HDR_BLOCK:			return &hdr;
+		case DIR_BLOCK:			return &dir;
+		case DIR_BACKUP_BLOCK:	return &dir_backup;
+		case BAT_BLOCK:			return &bat;
+		case BAT_BACKUP_BLOCK:	return &bat_backup;
+		default:				return NULL;
+	}
+}
+
+bool GCMemcard::Save()
+{
+	const bool compressed = GCMemcardCompressed::IsCompressedName(m_fileName);
+	if ((m_fileName == m_syncedFileName) && CanSaveInPlace())
+	{
+		if (!compressed && File::GetSize(m_fileName) == (u64)mci_offset + maxBlock * BLOCK_SIZE)
+			return SaveDirtyBlocks();
+
+		// the blocks replaced by earlier saves stay in a .mcz until it is written again
+		GCMemcardCompressed mczFile;
+		if (compressed && mczFile.Open(m_fileName, true) && mczFile.GetNumBlocks() == maxBlock &&
+			!mczFile.IsFragmented())
+		{
+			return SaveDirtyBlocks(mczFile);
+		}
+	}
+
+	// Write the whole card to a file next to it and only replace the card once
+	// that is on disk, a failed or interrupted save leaves the old card intact.
+	// A mapping or lazily read file keeps the old (identical) contents after the rename
+	const std::string tempFileName = m_fileName + ".tmp";
+	if (compressed)
+	{
+		if (!SaveCompressed(tempFileName))
+		{
+			File::Delete(tempFileName);
+			return false;
+		}
+	}
+	else
+	{
+		File::IOFile mcdFile(tempFileName, "wb");
+
+		if (mci_offset)
+		{
+			mcdFile.WriteBytes(&mci_hdr, MCI_HDR_SIZE);
+		}
+		mcdFile.Seek(mci_offset, SEEK_SET);
+
+		mcdFile.WriteBytes(&hdr, BLOCK_SIZE);
+		mcdFile.WriteBytes(&dir, BLOCK_SIZE);
+		mcdFile.WriteBytes(&dir_backup, BLOCK_SIZE);
+		mcdFile.WriteBytes(&bat, BLOCK_SIZE);
+		mcdFile.WriteBytes(&bat_backup, BLOCK_SIZE);
+		for (u16 i = MC_FST_BLOCKS; i < maxBlock; ++i)
+		{
+			mcdFile.WriteBytes(GetDataBlock(i).block, BLOCK_SIZE);
+		}
+
+		mcdFile.Sync();
+		if (!mcdFile.Close())
+		{
+			File::Delete(tempFileName);
+			return false;
+		}
+	}
 
-	mcdFile.WriteBytes(&hdr, BLOCK_SIZE);
-	mcdFile.WriteBytes(&dir, BLOCK_SIZE);
-	mcdFile.WriteBytes(&dir_backup, BLOCK_SIZE);
-	mcdFile.WriteBytes(&bat, BLOCK_SIZE);
-	mcdFile.WriteBytes(&bat_backup, BLOCK_SIZE);
-	for (u16 i = 0; i < maxBlock - MC_FST_BLOCKS; ++i)
+#ifdef _WIN32
+	// windows cannot replace a file that is still open or mapped
+	if (m_fileName == m_backingFileName)
+		ReleaseBackingFile();
+#endif
+	if (!File::Rename(tempFileName, m_fileName))
 	{
-		mcdFile.WriteBytes(mc_data_blocks[i].block, BLOCK_SIZE);
+		File::Delete(tempFileName);
+		return false;
 	}
 
-	return mcdFile.Close();
+	m_dirtyBlocks.assign(maxBlock, false);
+	m_syncedFileName = m_fileName;
+	return true;
+}
+
+bool GCMemcard::IsModified() const
+{
+	return std::find(m_dirtyBlocks.begin(), m_dirtyBlocks.end(), true) != m_dirtyBlocks.end();
+}
+
+bool GCMemcard::CanSaveInPlace() const
+{
+	// The header has no backup
+	if (m_dirtyBlocks[HDR_BLOCK])
+		return false;
+
+	// One of each directory and BAT pair has to stay as it is on disk,
+	// Load falls back to it if the other one is torn
+	if ((m_dirtyBlocks[DIR_BLOCK] && m_dirtyBlocks[DIR_BACKUP_BLOCK]) ||
+		(m_dirtyBlocks[BAT_BLOCK] && m_dirtyBlocks[BAT_BACKUP_BLOCK]))
+	{
+		return false;
+	}
+
+	// and none of the blocks it uses may be overwritten
+	for (u16 i = MC_FST_BLOCKS; i < maxBlock; ++i)
+	{
+		if (!m_dirtyBlocks[i])
+			continue;
+		if ((!m_dirtyBlocks[BAT_BLOCK] && bat.Map[i - MC_FST_BLOCKS]) ||
+			(!m_dirtyBlocks[BAT_BACKUP_BLOCK] && bat_backup.Map[i - MC_FST_BLOCKS]))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool GCMemcard::SaveDirtyBlocks()
+{
+	File::IOFile mcdFile(m_fileName, "r+b");
+
+	// Data blocks go first so the new directory never points at data
+	// that has not reached the disk. The directory is on disk before the
+	// BAT, which is what Load expects when one of them is torn or it stops
+	// in between
+	WriteDirtyBlocks(mcdFile, MC_FST_BLOCKS, maxBlock);
+	mcdFile.Sync();
+	WriteDirtyBlocks(mcdFile, 0, BAT_BLOCK);
+	mcdFile.Sync();
+	WriteDirtyBlocks(mcdFile, BAT_BLOCK, MC_FST_BLOCKS);
+	mcdFile.Sync();
+
+	if (!mcdFile.Close())
+		return false;
+
+	m_dirtyBlocks.assign(maxBlock, false);
+	return true;
+}
+
+bool GCMemcard::SaveDirtyBlocks(GCMemcardCompressed &mczFile)
+{
+	// Data blocks go first here as well, each Commit syncs the blocks
+	// before it points the index at them
+	bool written = true;
+	for (u16 i = MC_FST_BLOCKS; i < maxBlock; ++i)
+		if (m_dirtyBlocks[i])
+			written = written && mczFile.WriteBlock(i, GetDataBlock(i).block);
+	written = written && mczFile.Commit();
+	for (u16 i = 0; i < BAT_BLOCK; ++i)
+		if (m_dirtyBlocks[i])
+			written = written && mczFile.WriteBlock(i, (const u8*)GetSystemBlock(i));
+	written = written && mczFile.Commit();
+	for (u16 i = BAT_BLOCK; i < MC_FST_BLOCKS; ++i)
+		if (m_dirtyBlocks[i])
+			written = written && mczFile.WriteBlock(i, (const u8*)GetSystemBlock(i));
+	written = written && mczFile.Commit();
+
+	if (!mczFile.Close() || !written)
+		return false;
+
+	m_dirtyBlocks.assign(maxBlock, false);
+	return true;
+}
+
+bool GCMemcard::SaveCompressed(const std::string &fileName)
+{
+	GCMemcardCompressed mczFile;
+	if (!mczFile.Create(fileName, maxBlock))
+		return false;
+
+	bool written = true;
+	for (u16 i = 0; i < maxBlock && written; ++i)
+		written = mczFile.WriteBlock(i, i < MC_FST_BLOCKS ? (const u8*)GetSystemBlock(i) : GetDataBlock(i).block);
+	written = written && mczFile.Commit();
+	return mczFile.Close() && written;
+}
+
+void GCMemcard::WriteDirtyBlocks(File::IOFile &mcdFile, u16 first, u16 last) const
+{
+	bool seek = true;
+	for (u16 i = first; i < last; ++i)
+	{
+		if (!m_dirtyBlocks[i])
+		{
+			seek = true;
+			continue;
+		}
+		// runs of dirty blocks are written with a single seek
+		if (seek)
+			mcdFile.Seek(mci_offset + i * BLOCK_SIZE, SEEK_SET);
+		seek = false;
+
+		if (i < MC_FST_BLOCKS)
+			mcdFile.WriteBytes(GetSystemBlock(i), BLOCK_SIZE);
+		else
+			mcdFile.WriteBytes(GetDataBlock(i).block, BLOCK_SIZE);
+	}
 }
 
 bool GCMemcard::SaveAs(const char * destination)
@@ -388,6 +832,9 @@ bool GCMemcard::ChangeMemoryCardSize(u16 SizeMb)
 		return false;
 	}
 
+	// the backing file has a fixed size
+	ReleaseBackingFile();
+
 	m_sizeMb = SizeMb;
 	*(u16*)hdr.SizeMb = BE16(m_sizeMb);
 
@@ -396,8 +843,14 @@ bool GCMemcard::ChangeMemoryCardSize(u16 SizeMb)
 	maxBlock = m_sizeMb * MBIT_TO_BLOCKS;
 	u16 addedblocks = (u16)(maxBlock - oldmaxBlock);
 
+	// the whole file has to be rewritten at the new size
+	m_dirtyBlocks.assign(maxBlock, true);
+	m_testedChecksums = 0;
+	m_syncedFileName.clear();
+
 	CurrentBat->FreeBlocks  = BE16(BE16(CurrentBat->FreeBlocks)  + addedblocks);
 	PreviousBat->FreeBlocks = BE16(BE16(PreviousBat->FreeBlocks) + addedblocks);
+	m_freeBlocks.Rebuild(*CurrentBat, maxBlock);
 
 	FixChecksums();
 
@@ -453,9 +906,11 @@ bool GCMemcard::ReplaceHDR(const char *hdrFileName, const char * destination)
 	calc_checksumsBE((u16*)&new_hdr, 0xFE, &new_hdr.Checksum, &new_hdr.Checksum_Inv);
 	
 	hdr = new_hdr;
+	MarkDirty(HDR_BLOCK);
 	if (!SaveAs(destination))
 	{
 		hdr = old_hdr;
+		MarkDirty(HDR_BLOCK);
 		return false;
 	}
 	return true;
@@ -468,18 +923,57 @@ bool GCMemcard::ExportHDR(const char *hdrFileName) const
 	return hdrFile.Close();
 }
 
-void GCMemcard::calc_checksumsBE(u16 *buf, u32 length, u16 *csum, u16 *inv_csum)
+static u16 SumBE16_Scalar(const u16 *buf, u32 length)
 {
-	*csum = *inv_csum = 0;
-
+	u16 sum = 0;
 	for (u32 i = 0; i < length; ++i)
+		sum += BE16(buf[i]);
+	return sum;
+}
+
+#ifdef GCMEMCARD_SSE2
+// adds up 8 byte swapped values at a time in 16 bit lanes, the lanes
+// wrap around just like the scalar sum so the result is the same
+static u16 SumBE16_SSE2(const u16 *buf, u32 length)
+{
+	__m128i acc = _mm_setzero_si128();
+	u32 i = 0;
+	for (; i + 8 <= length; i += 8)
 	{
-		//weird warnings here
-		*csum += BE16(buf[i]);
-		*inv_csum += BE16((u16)(buf[i] ^ 0xffff));
+		__m128i val = _mm_loadu_si128((const __m128i*)(buf + i));
+		acc = _mm_add_epi16(acc, _mm_or_si128(_mm_slli_epi16(val, 8), _mm_srli_epi16(val, 8)));
 	}
-	*csum = BE16(*csum);
-	*inv_csum = BE16(*inv_csum);
+	acc = _mm_add_epi16(acc, _mm_srli_si128(acc, 8));
+	acc = _mm_add_epi16(acc, _mm_srli_si128(acc, 4));
+	acc = _mm_add_epi16(acc, _mm_srli_si128(acc, 2));
+	u16 sum = (u16)_mm_cvtsi128_si32(acc);
+
+	for (; i < length; ++i)
+		sum += BE16(buf[i]);
+	return sum;
+}
+#endif
+
+static u16 SumBE16(const u16 *buf, u32 length)
+{
+#ifdef GCMEMCARD_AVX2
+	if (cpu_info.bAVX2)
+		return SumBE16_AVX2(buf, length);
+#endif
+#ifdef GCMEMCARD_SSE2
+	if (cpu_info.bSSE2)
+		return SumBE16_SSE2(buf, length);
+#endif
+	return SumBE16_Scalar(buf, length);
+}
+
+void GCMemcard::calc_checksumsBE(u16 *buf, u32 length, u16 *csum, u16 *inv_csum)
+{
+	// the inverse checksum adds up (x ^ 0xffff) = 0xffff - x, which is
+	// -1 - x in 16 bits, so it follows from the checksum: -length - sum
+	u16 sum = SumBE16(buf, length);
+	*csum = BE16(sum);
+	*inv_csum = BE16((u16)(0 - length - sum));
 	if (*csum == 0xffff)
 	{
 		*csum = 0;
@@ -490,29 +984,48 @@ void GCMemcard::calc_checksumsBE(u16 *buf, u32 length, u16 *csum, u16 *inv_csum)
 	}
 }
 
+void GCMemcard::SetChecksumResult(u16 block, bool failed) const
+{
+	m_testedChecksums |= 1 << block;
+	if (failed)
+		m_checksumResults |= 1 << block;
+	else
+		m_checksumResults &= ~(1 << block);
+}
+
 u32  GCMemcard::TestChecksums() const
 {
 	u16 csum=0,
 		csum_inv=0;
 
-	u32 results = 0;
-
-	calc_checksumsBE((u16*)&hdr, 0xFE , &csum, &csum_inv);
-	if ((hdr.Checksum != csum) || (hdr.Checksum_Inv != csum_inv)) results |= 1;
-
-	calc_checksumsBE((u16*)&dir, 0xFFE, &csum, &csum_inv);
-	if ((dir.Checksum != csum) || (dir.Checksum_Inv != csum_inv)) results |= 2;
-
-	calc_checksumsBE((u16*)&dir_backup, 0xFFE, &csum, &csum_inv);
-	if ((dir_backup.Checksum != csum) || (dir_backup.Checksum_Inv != csum_inv)) results |= 4;
-
-	calc_checksumsBE((u16*)(((u8*)&bat)+4), 0xFFE, &csum, &csum_inv);
-	if ((bat.Checksum != csum) || (bat.Checksum_Inv != csum_inv)) results |= 8;
-
-	calc_checksumsBE((u16*)(((u8*)&bat_backup)+4), 0xFFE, &csum, &csum_inv);
-	if ((bat_backup.Checksum != csum) || (bat_backup.Checksum_Inv != csum_inv)) results |= 16;
+	// blocks that weren't marked dirty since their last test keep their result
+	if (!(m_testedChecksums & (1 << HDR_BLOCK)))
+	{
+		calc_checksumsBE((u16*)&hdr, 0xFE , &csum, &csum_inv);
+		SetChecksumResult(HDR_BLOCK, (hdr.Checksum != csum) || (hdr.Checksum_Inv != csum_inv));
+	}
+	if (!(m_testedChecksums & (1 << DIR_BLOCK)))
+	{
+		calc_checksumsBE((u16*)&dir, 0xFFE, &csum, &csum_inv);
+		SetChecksumResult(DIR_BLOCK, (dir.Checksum != csum) || (dir.Checksum_Inv != csum_inv));
+	}
+	if (!(m_testedChecksums & (1 << DIR_BACKUP_BLOCK)))
+	{
+		calc_checksumsBE((u16*)&dir_backup, 0xFFE, &csum, &csum_inv);
+		SetChecksumResult(DIR_BACKUP_BLOCK, (dir_backup.Checksum != csum) || (dir_backup.Checksum_Inv != csum_inv));
+	}
+	if (!(m_testedChecksums & (1 << BAT_BLOCK)))
+	{
+		calc_checksumsBE((u16*)(((u8*)&bat)+4), 0xFFE, &csum, &csum_inv);
+		SetChecksumResult(BAT_BLOCK, (bat.Checksum != csum) || (bat.Checksum_Inv != csum_inv));
+	}
+	if (!(m_testedChecksums & (1 << BAT_BACKUP_BLOCK)))
+	{
+		calc_checksumsBE((u16*)(((u8*)&bat_backup)+4), 0xFFE, &csum, &csum_inv);
+		SetChecksumResult(BAT_BACKUP_BLOCK, (bat_backup.Checksum != csum) || (bat_backup.Checksum_Inv != csum_inv));
+	}
 
-	return results;
+	return m_checksumResults;
 }
 
 bool GCMemcard::FixChecksums()
@@ -520,6 +1033,12 @@ bool GCMemcard::FixChecksums()
 	if (!m_valid)
 		return false;
 	
+	// blocks with stale checksums have to be written out again
+	u32 csums = TestChecksums();
+	for (u16 i = 0; i < MC_FST_BLOCKS; ++i)
+		if (csums & (1 << i))
+			MarkDirty(i);
+
 	calc_checksumsBE((u16*)&hdr, 0xFE, &hdr.Checksum, &hdr.Checksum_Inv);
 	calc_checksumsBE((u16*)&dir, 0xFFE, &dir.Checksum, &dir.Checksum_Inv);
 	calc_checksumsBE((u16*)&dir_backup, 0xFFE, &dir_backup.Checksum, &dir_backup.Checksum_Inv);
@@ -534,33 +1053,13 @@ u8 GCMemcard::GetNumFiles() const
 	if (!m_valid)
 		return 0;
 
-	u8 j = 0;
-	for (int i = 0; i < DIRLEN; i++)
-	{
-		if (BE32(CurrentDir->Dir[i].Gamecode)!= 0xFFFFFFFF)
-			 j++;
-	}
-	return j;
+	return m_dirIndex.NumFiles;
 }
 
 u8 GCMemcard::GetFileIndex(u8 fileNumber) const
 {
-	if (m_valid)
-	{
-
-		u8 j = 0;
-		for (u8 i = 0; i < DIRLEN; i++)
-		{
-			if (BE32(CurrentDir->Dir[i].Gamecode)!= 0xFFFFFFFF)
-			{
-				if (j == fileNumber)
-				{
-					return i;
-				}
-				j++;
-			}
-		}
-	}
+	if (m_valid && fileNumber < m_dirIndex.NumFiles)
+		return m_dirIndex.Files[fileNumber];
 	return 0xFF;
 }
 
@@ -572,32 +1071,60 @@ u16 GCMemcard::GetFreeBlocks() const
 	return BE16(CurrentBat->FreeBlocks);
 }
 
-u8 GCMemcard::TitlePresent(DEntry d) const
+void GCMemcard::GetFileList(std::vector<FileInfo> &files) const
 {
+	files.clear();
 	if (!m_valid)
-		return DIRLEN;
+		return;
 
-	u8 i = 0;
-	while(i < DIRLEN)
-	{
-		if ((BE32(CurrentDir->Dir[i].Gamecode) == BE32(d.Gamecode)) &&
-			(!memcmp(CurrentDir->Dir[i].Filename, d.Filename, 32)))
+	files.resize(m_dirIndex.NumFiles);
+	for (u8 i = 0; i < m_dirIndex.NumFiles; ++i)
+	{
+		FileInfo &file = files[i];
+		const DEntry &entry = CurrentDir->Dir[m_dirIndex.Files[i]];
+		file.index = m_dirIndex.Files[i];
+		file.blockCount = DEntry_BlockCount(file.index);
+		file.firstBlock = DEntry_FirstBlock(file.index);
+
+		// both comments are read at once, same results as GetSaveComment1/2
+		char comments[DENTRY_STRLEN * 2];
+		u16 firstBlock = BE16(entry.FirstBlock);
+		u32 commentsAddr = BE32(entry.CommentsAddr);
+		if ((firstBlock < MC_FST_BLOCKS) || (firstBlock >= maxBlock) || (commentsAddr == 0xFFFFFFFF))
+			continue;
+		if (ReadSaveData(file.index, commentsAddr, DENTRY_STRLEN * 2, (u8*)comments))
 		{
-			break;
+			file.title = std::string(comments, DENTRY_STRLEN);
+			file.comment = std::string(comments + DENTRY_STRLEN, DENTRY_STRLEN);
+		}
+		else if (ReadSaveData(file.index, commentsAddr, DENTRY_STRLEN, (u8*)comments))
+		{
+			file.title = std::string(comments, DENTRY_STRLEN);
 		}
-		i++;
 	}
-	return i;
+}
+
+u8 GCMemcard::TitlePresent(DEntry d) const
+{
+	if (!m_valid)
+		return DIRLEN;
+
+	return m_dirIndex.Find(*CurrentDir, d);
 }
 
 bool GCMemcard::GCI_FileName(u8 index, std::string &filename) const
 {
 	if (!m_valid || index > DIRLEN || (BE32(CurrentDir->Dir[index].Gamecode) == 0xFFFFFFFF))
 		return false;
-	filename = std::string((char*)CurrentDir->Dir[index].Gamecode, 4) + '_' + (char*)CurrentDir->Dir[index].Filename + ".gci";
+	filename = GciFileName(CurrentDir->Dir[index]);
 	return true;
 }
 
+std::string GCMemcard::GciFileName(const DEntry &d)
+{
+	return std::string((char*)d.Gamecode, 4) + '_' + (char*)d.Filename + ".gci";
+}
+
 // DEntry functions, all take u8 index < DIRLEN (127)
 // Functions that have ascii output take a char *buffer
 
@@ -737,12 +1264,15 @@ std::string GCMemcard::GetSaveComment1(u8 index) const
 		return "";
 
 	u32 Comment1 = BE32(CurrentDir->Dir[index].CommentsAddr);
-	u16 DataBlock = BE16(CurrentDir->Dir[index].FirstBlock) - MC_FST_BLOCKS;
-	if ((DataBlock > maxBlock) || (Comment1 == 0xFFFFFFFF))
+	u16 DataBlock = BE16(CurrentDir->Dir[index].FirstBlock);
+	if ((DataBlock < MC_FST_BLOCKS) || (DataBlock >= maxBlock) || (Comment1 == 0xFFFFFFFF))
 	{
 		return "";
 	}
-	return std::string((const char *)mc_data_blocks[DataBlock].block + Comment1, DENTRY_STRLEN);
+	char comment[DENTRY_STRLEN];
+	if (!ReadSaveData(index, Comment1, DENTRY_STRLEN, (u8*)comment))
+		return "";
+	return std::string(comment, DENTRY_STRLEN);
 }
 
 std::string GCMemcard::GetSaveComment2(u8 index) const
@@ -752,12 +1282,15 @@ std::string GCMemcard::GetSaveComment2(u8 index) const
 
 	u32 Comment1 = BE32(CurrentDir->Dir[index].CommentsAddr);
 	u32 Comment2 = Comment1 + DENTRY_STRLEN;
-	u16 DataBlock = BE16(CurrentDir->Dir[index].FirstBlock) - MC_FST_BLOCKS;
-	if ((DataBlock > maxBlock) || (Comment1 == 0xFFFFFFFF))
+	u16 DataBlock = BE16(CurrentDir->Dir[index].FirstBlock);
+	if ((DataBlock < MC_FST_BLOCKS) || (DataBlock >= maxBlock) || (Comment1 == 0xFFFFFFFF))
 	{
 		return "";
 	}
-	return std::string((const char *)mc_data_blocks[DataBlock].block + Comment2, DENTRY_STRLEN);
+	char comment[DENTRY_STRLEN];
+	if (!ReadSaveData(index, Comment2, DENTRY_STRLEN, (u8*)comment))
+		return "";
+	return std::string(comment, DENTRY_STRLEN);
 }
 
 bool GCMemcard::GetDEntry(u8 index, DEntry &dest) const
@@ -768,28 +1301,107 @@ bool GCMemcard::GetDEntry(u8 index, DEntry &dest) const
 	return true;
 }
 
-u16 GCMemcard::BlockAlloc::GetNextBlock(u16 Block) const
+u32 GCMemcard::CheckFileSystem(std::vector<std::string> &problems) const
 {
-	if ((Block < MC_FST_BLOCKS) || (Block > 4091))
-		return 0;
-	return Common::swap16(Map[Block-MC_FST_BLOCKS]);
+	if (!m_valid)
+		return NOMEMCARD;
+
+	const size_t oldProblems = problems.size();
+
+	static const char *blockNames[MC_FST_BLOCKS] = {
+		"Header", "Directory", "Directory backup",
+		"Block allocation table", "Block allocation table backup" };
+	u32 csums = TestChecksums();
+	for (u16 i = 0; i < MC_FST_BLOCKS; ++i)
+	{
+		if (csums & (1 << i))
+			problems.push_back(StringFromFormat("%s checksum is invalid", blockNames[i]));
+		else if (m_loadChecksums & (1 << i))
+			problems.push_back(StringFromFormat("%s checksum was invalid, restored from the other copy", blockNames[i]));
+	}
+
+	if (m_restoredOlderDir)
+		problems.push_back("Directory was ahead of the block allocation table, restored the older directory");
+	CheckDirBat(*CurrentDir, *CurrentBat, &problems);
+
+	return (problems.size() == oldProblems) ? SUCCESS : FAIL;
 }
 
-u16 GCMemcard::BlockAlloc::NextFreeBlock(u16 StartingBlock) const
+bool GCMemcard::CheckDirBat(const Directory &Dir, const BlockAlloc &Bat, std::vector<std::string> *problems) const
 {
-	if (FreeBlocks)
+	bool agree = true;
+
+	// directory index of the file using each block, 0xFF for none
+	std::vector<u8> owner(maxBlock, 0xFF);
+	for (u8 i = 0; i < DIRLEN; ++i)
 	{
-		for (u16 i = StartingBlock; i < BAT_SIZE; ++i)
-			if (Map[i-MC_FST_BLOCKS] == 0)
-				return i;
-		for (u16 i = 0; i < StartingBlock; ++i)
-			if (Map[i-MC_FST_BLOCKS] == 0)
-				return i;
+		if (BE32(Dir.Dir[i].Gamecode) == 0xFFFFFFFF)
+			continue;
+
+		const std::string fileName = problems ? GciFileName(Dir.Dir[i]) : "";
+		u16 block = BE16(Dir.Dir[i].FirstBlock);
+		u16 blockCount = BE16(Dir.Dir[i].BlockCount);
+		u16 length = 0;
+		while ((block != 0xFFFF) && (length <= blockCount))
+		{
+			if ((block < MC_FST_BLOCKS) || (block >= maxBlock))
+			{
+				if (problems)
+					problems->push_back(StringFromFormat("%s: block %d is outside the card", fileName.c_str(), block));
+				agree = false;
+				break;
+			}
+			if (owner[block] != 0xFF)
+			{
+				if (problems)
+					problems->push_back(StringFromFormat("%s: block %d is also used by %s", fileName.c_str(), block,
+						GciFileName(Dir.Dir[owner[block]]).c_str()));
+				agree = false;
+				break;
+			}
+			owner[block] = i;
+			++length;
+			block = Bat.GetNextBlock(block);
+		}
+		if (length != blockCount)
+		{
+			if (problems)
+				problems->push_back(StringFromFormat("%s: %d blocks are allocated, the directory entry has %d", fileName.c_str(), length, blockCount));
+			agree = false;
+		}
+	}
+
+	u16 freeBlocks = 0, lostBlocks = 0;
+	for (u16 i = MC_FST_BLOCKS; i < maxBlock; ++i)
+	{
+		if (!Bat.Map[i - MC_FST_BLOCKS])
+			++freeBlocks;
+		else if (owner[i] == 0xFF)
+			++lostBlocks;
+	}
+	if (lostBlocks)
+	{
+		if (problems)
+			problems->push_back(StringFromFormat("%d blocks are allocated but not used by any file", lostBlocks));
+		agree = false;
 	}
-	return 0xFFFF;
+	if (freeBlocks != BE16(Bat.FreeBlocks))
+	{
+		if (problems)
+			problems->push_back(StringFromFormat("Free block count is %d, the allocation map has %d free blocks", BE16(Bat.FreeBlocks), freeBlocks));
+		agree = false;
+	}
+	return agree;
+}
+
+u16 GCMemcard::BlockAlloc::GetNextBlock(u16 Block) const
+{
+	if ((Block < MC_FST_BLOCKS) || (Block > 4091))
+		return 0;
+	return Common::swap16(Map[Block-MC_FST_BLOCKS]);
 }
 
-bool GCMemcard::BlockAlloc::ClearBlocks(u16 FirstBlock, u16 BlockCount)
+bool GCMemcard::BlockAlloc::ClearBlocks(u16 FirstBlock, u16 BlockCount, FreeBlockMap &FreeBlocksMap)
 {
 	std::vector<u16> blocks;
 	while (FirstBlock != 0xFFFF && FirstBlock != 0)
@@ -805,7 +1417,10 @@ bool GCMemcard::BlockAlloc::ClearBlocks(u16 FirstBlock, u16 BlockCount)
 			return false;
 		}
 		for (int i = 0; i < length; ++i)
+		{
 			Map[blocks.at(i)-MC_FST_BLOCKS] = 0;
+			FreeBlocksMap.Free(blocks.at(i));
+		}
 		FreeBlocks = BE16(BE16(FreeBlocks) + BlockCount);
 
 		return true;
@@ -813,7 +1428,128 @@ bool GCMemcard::BlockAlloc::ClearBlocks(u16 FirstBlock, u16 BlockCount)
 	return false;
 }
 
+void GCMemcard::FreeBlockMap::Rebuild(const BlockAlloc &Bat, u16 _MaxBlock)
+{
+	MaxBlock = _MaxBlock;
+	memset(Bits, 0, sizeof(Bits));
+	for (u16 i = MC_FST_BLOCKS; i < MaxBlock; ++i)
+		if (Bat.Map[i-MC_FST_BLOCKS] == 0)
+			Free(i);
+}
+
+u16 GCMemcard::FreeBlockMap::Scan(u16 Block) const
+{
+	const u32 numWords = sizeof(Bits) / sizeof(Bits[0]);
+	for (u32 word = Block / 32; word < numWords; ++word)
+	{
+		u32 bits = Bits[word];
+		if (word == Block / 32)
+			bits &= ~0u << (Block % 32);
+		if (bits)
+			return (u16)(word * 32 + Common::LeastSignificantSetBit(bits));
+	}
+	return MC_FST_BLOCKS + BAT_SIZE;
+}
+
+bool GCMemcard::FreeBlockMap::FindFreeBlocks(u16 StartingBlock, u32 Count, std::vector<u16> &Blocks) const
+{
+	Blocks.clear();
+	Blocks.reserve(Count);
+	u16 block = StartingBlock;
+	bool wrapped = false;
+	while (Blocks.size() < Count)
+	{
+		block = Scan(block);
+		if (block == MC_FST_BLOCKS + BAT_SIZE || (wrapped && block >= StartingBlock))
+		{
+			// everything from StartingBlock on was seen before wrapping around
+			if (wrapped)
+				return false;
+			wrapped = true;
+			block = MC_FST_BLOCKS;
+			continue;
+		}
+		Blocks.push_back(block++);
+	}
+	return true;
+}
+
+u8 GCMemcard::DirectoryIndex::Hash(const DEntry &d)
+{
+	// FNV-1a
+	u32 hash = 2166136261u;
+	for (int i = 0; i < 4; ++i)
+		hash = (hash ^ d.Gamecode[i]) * 16777619u;
+	for (int i = 0; i < DENTRY_STRLEN; ++i)
+		hash = (hash ^ d.Filename[i]) * 16777619u;
+	return (u8)((hash ^ (hash >> 16)) % sizeof(Buckets));
+}
+
+void GCMemcard::DirectoryIndex::Rebuild(const Directory &Dir)
+{
+	NumFiles = 0;
+	memset(Buckets, 0xFF, sizeof(Buckets));
+	for (u8 i = 0; i < DIRLEN; ++i)
+		if (BE32(Dir.Dir[i].Gamecode) != 0xFFFFFFFF)
+			Add(Dir, i);
+}
+
+void GCMemcard::DirectoryIndex::Add(const Directory &Dir, u8 Index)
+{
+	// Files stays in directory order, it has at most 127 entries
+	u8 pos = NumFiles;
+	while (pos > 0 && Files[pos-1] > Index)
+		--pos;
+	memmove(Files + pos + 1, Files + pos, NumFiles - pos);
+	Files[pos] = Index;
+	++NumFiles;
+
+	u8 bucket = Hash(Dir.Dir[Index]);
+	Next[Index] = Buckets[bucket];
+	Buckets[bucket] = Index;
+}
+
+void GCMemcard::DirectoryIndex::Remove(const Directory &Dir, u8 Index)
+{
+	u8 pos = 0;
+	while (pos < NumFiles && Files[pos] != Index)
+		++pos;
+	if (pos == NumFiles)
+		return;
+	--NumFiles;
+	memmove(Files + pos, Files + pos + 1, NumFiles - pos);
+
+	u8 *link = &Buckets[Hash(Dir.Dir[Index])];
+	while (*link != Index)
+		link = &Next[*link];
+	*link = Next[Index];
+}
+
+u8 GCMemcard::DirectoryIndex::Find(const Directory &Dir, const DEntry &d) const
+{
+	// a broken directory can have the same file twice, the first one wins
+	u8 found = DIRLEN;
+	for (u8 i = Buckets[Hash(d)]; i != 0xFF; i = Next[i])
+	{
+		if ((i < found) && !memcmp(Dir.Dir[i].Gamecode, d.Gamecode, 4) &&
+			!memcmp(Dir.Dir[i].Filename, d.Filename, DENTRY_STRLEN))
+		{
+			found = i;
+		}
+	}
+	return found;
+}
+
 u32 GCMemcard::GetSaveData(u8 index,  std::vector<GCMBlock> & Blocks) const
+{
+	std::vector<const GCMBlock*> saveBlocks;
+	u32 result = GetSaveBlocks(index, saveBlocks);
+	for (u32 i = 0; i < saveBlocks.size(); ++i)
+		Blocks.push_back(*saveBlocks[i]);
+	return result;
+}
+
+u32 GCMemcard::GetSaveBlocks(u8 index, std::vector<const GCMBlock*> &Blocks) const
 {
 	if (!m_valid)
 		return NOMEMCARD;
@@ -822,7 +1558,8 @@ u32 GCMemcard::GetSaveData(u8 index,  std::vector<GCMBlock> & Blocks) const
 	u16 BlockCount = DEntry_BlockCount(index);
 	//u16 memcardSize = BE16(hdr.SizeMb) * MBIT_TO_BLOCKS;
 
-	if ((block == 0xFFFF) || (BlockCount == 0xFFFF))
+	// a file without blocks doesn't need to point at one
+	if (((block == 0xFFFF) && BlockCount) || (BlockCount == 0xFFFF))
 	{
 		return FAIL;
 	}
@@ -830,54 +1567,121 @@ u32 GCMemcard::GetSaveData(u8 index,  std::vector<GCMBlock> & Blocks) const
 	u16 nextBlock = block;
 	for (int i = 0; i < BlockCount; ++i)
 	{
-		if ((!nextBlock) || (nextBlock == 0xFFFF))
+		if ((nextBlock < MC_FST_BLOCKS) || (nextBlock >= maxBlock))
 			return FAIL;
-		Blocks.push_back(mc_data_blocks[nextBlock-MC_FST_BLOCKS]);
+		Blocks.push_back(&GetDataBlock(nextBlock));
 		nextBlock = CurrentBat->GetNextBlock(nextBlock);
 	}
 	return SUCCESS;
 }
+
+bool GCMemcard::ReadSaveData(u8 index, u32 offset, u32 length, u8* dest) const
+{
+	u16 block = BE16(CurrentDir->Dir[index].FirstBlock);
+	u32 saveSize = BE16(CurrentDir->Dir[index].BlockCount) * BLOCK_SIZE;
+	if ((offset > saveSize) || (length > saveSize - offset))
+		return false;
+
+	for (u32 i = 0; i < offset / BLOCK_SIZE; ++i)
+	{
+		if ((block < MC_FST_BLOCKS) || (block >= maxBlock))
+			return false;
+		block = CurrentBat->GetNextBlock(block);
+	}
+	offset %= BLOCK_SIZE;
+
+	while (length)
+	{
+		if ((block < MC_FST_BLOCKS) || (block >= maxBlock))
+			return false;
+		u32 size = std::min<u32>(length, BLOCK_SIZE - offset);
+		memcpy(dest, GetDataBlock(block).block + offset, size);
+		dest += size;
+		length -= size;
+		offset = 0;
+		block = CurrentBat->GetNextBlock(block);
+	}
+	return true;
+}
 // End DEntry functions
 
 u32 GCMemcard::ImportFile(DEntry& direntry, std::vector<GCMBlock> &saveBlocks)
+{
+	std::vector<const GCMBlock*> blocks(saveBlocks.size());
+	for (u32 i = 0; i < saveBlocks.size(); ++i)
+		blocks[i] = &saveBlocks[i];
+	return ImportFile(direntry, blocks);
+}
+
+u32 GCMemcard::ImportFile(DEntry& direntry, const std::vector<const GCMBlock*> &saveBlocks)
 {
 	if (!m_valid)
 		return NOMEMCARD;
 
-	if (GetNumFiles() >= DIRLEN)
+	if (m_dirIndex.NumFiles >= DIRLEN)
 	{
 		return OUTOFDIRENTRIES;
 	}
-	if (BE16(CurrentBat->FreeBlocks) < BE16(direntry.BlockCount))
+	u16 fileBlocks = BE16(direntry.BlockCount);
+	if (BE16(CurrentBat->FreeBlocks) < fileBlocks)
 	{
 		return OUTOFBLOCKS;
 	}
-	if (TitlePresent(direntry) != DIRLEN)
+	if (m_dirIndex.Find(*CurrentDir, direntry) != DIRLEN)
 	{
 		return TITLEPRESENT;
 	}
 
-	// find first free data block
-	u16 firstBlock = CurrentBat->NextFreeBlock(BE16(CurrentBat->LastAllocated));
-	if (firstBlock == 0xFFFF)
-		return OUTOFBLOCKS;
-	Directory UpdatedDir = *CurrentDir;
-	
+	std::vector<u16> blocks;
+	if (!m_freeBlocks.FindFreeBlocks(BE16(CurrentBat->LastAllocated), fileBlocks, blocks))
+		return OUTOFBLOCKS;
+
+	Directory UpdatedDir = *CurrentDir;
+	BlockAlloc UpdatedBat = *CurrentBat;
+	AddFile(UpdatedDir, UpdatedBat, direntry, saveBlocks, blocks.empty() ? NULL : &blocks[0]);
+	CommitDirBat(UpdatedDir, UpdatedBat);
+	return SUCCESS;
+}
+
+void GCMemcard::AddFile(Directory &UpdatedDir, BlockAlloc &UpdatedBat, DEntry& direntry, const std::vector<const GCMBlock*> &saveBlocks, const u16 *blocks)
+{
+	u16 fileBlocks = BE16(direntry.BlockCount);
+
 	// find first free dir entry
-	int index = -1;
 	for (int i=0; i < DIRLEN; i++)
 	{
 		if (BE32(UpdatedDir.Dir[i].Gamecode) == 0xFFFFFFFF)
 		{
-			index = i;
 			UpdatedDir.Dir[i] = direntry;
-			*(u16*)&UpdatedDir.Dir[i].FirstBlock = BE16(firstBlock);
+			*(u16*)&UpdatedDir.Dir[i].FirstBlock = fileBlocks ? BE16(blocks[0]) : 0xFFFF;
 			UpdatedDir.Dir[i].CopyCounter = UpdatedDir.Dir[i].CopyCounter+1;
+			m_dirIndex.Add(UpdatedDir, i);
 			break;
 		}
 	}
+
+	std::vector<GCMBlock*> fileBuffer(fileBlocks);
+	for (u16 i = 0; i < fileBlocks; ++i)
+	{ 
+		fileBuffer[i] = &GetDataBlockForWrite(blocks[i]);
+		*fileBuffer[i] = *saveBlocks[i];
+		m_freeBlocks.Allocate(blocks[i]);
+		UpdatedBat.Map[blocks[i] - MC_FST_BLOCKS] = BE16((i == fileBlocks-1) ? 0xFFFF : blocks[i+1]);
+		UpdatedBat.LastAllocated = BE16(blocks[i]);
+	}
+	
+	// the save may come straight from another card, it is fixed where it was copied to
+	FZEROGX_MakeSaveGameValid(direntry, fileBuffer);
+	PSO_MakeSaveGameValid(direntry, fileBuffer);
+
+	UpdatedBat.FreeBlocks = BE16(BE16(UpdatedBat.FreeBlocks)  - fileBlocks);
+}
+
+void GCMemcard::CommitDirBat(Directory &UpdatedDir, BlockAlloc &UpdatedBat)
+{
 	UpdatedDir.UpdateCounter = BE16(BE16(UpdatedDir.UpdateCounter) + 1);
 	*PreviousDir = UpdatedDir;
+	MarkDirty(PreviousDir);
 	if (PreviousDir == &dir )
 	{
 		CurrentDir = &dir;
@@ -889,31 +1693,9 @@ u32 GCMemcard::ImportFile(DEntry& direntry, std::vector<GCMBlock> &saveBlocks)
 		PreviousDir = &dir;
 	}
 
-	u16 fileBlocks = BE16(direntry.BlockCount);
-
-	FZEROGX_MakeSaveGameValid(direntry, saveBlocks);
-	PSO_MakeSaveGameValid(direntry, saveBlocks);
-
-	BlockAlloc UpdatedBat = *CurrentBat;
-	u16 nextBlock;
-	// keep assuming no freespace fragmentation, and copy over all the data
-	for (u16 i = 0; i < fileBlocks; ++i)
-	{ 
-		if (firstBlock == 0xFFFF)
-			PanicAlert("Fatal Error");
-		mc_data_blocks[firstBlock - MC_FST_BLOCKS] = saveBlocks[i];
-		if (i == fileBlocks-1)
-			nextBlock = 0xFFFF;
-		else
-			nextBlock = UpdatedBat.NextFreeBlock(firstBlock+1);		
-		UpdatedBat.Map[firstBlock - MC_FST_BLOCKS] = BE16(nextBlock);
-		UpdatedBat.LastAllocated = BE16(firstBlock);
-		firstBlock = nextBlock;
-	}
-	
-	UpdatedBat.FreeBlocks = BE16(BE16(UpdatedBat.FreeBlocks)  - fileBlocks);
 	UpdatedBat.UpdateCounter = BE16(BE16(UpdatedBat.UpdateCounter) + 1);
 	*PreviousBat = UpdatedBat;
+	MarkDirty(PreviousBat);
 	if (PreviousBat == &bat )
 	{
 		CurrentBat = &bat;
@@ -924,7 +1706,75 @@ u32 GCMemcard::ImportFile(DEntry& direntry, std::vector<GCMBlock> &saveBlocks)
 		CurrentBat = &bat_backup;
 		PreviousBat = &bat;
 	}
+}
+
+u32 GCMemcard::ImportBatch(const std::vector<std::string> &inputFiles, std::vector<u32> &results)
+{
+	results.assign(inputFiles.size(), NOMEMCARD);
+	if (!m_valid)
+		return NOMEMCARD;
+
+	// every file is read and checked before the card is touched
+	u32 result = SUCCESS;
+	u32 totalBlocks = 0;
+	std::vector<DEntry> dentries(inputFiles.size());
+	std::vector<std::vector<GCMBlock> > saves(inputFiles.size());
+	for (u32 i = 0; i < inputFiles.size(); ++i)
+	{
+		File::IOFile gci(inputFiles[i], "rb");
+		if (!gci)
+			results[i] = OPENFAIL;
+		else
+			results[i] = ReadGci(gci, inputFiles[i], dentries[i], saves[i]);
+
+		if (results[i] == SUCCESS && m_dirIndex.Find(*CurrentDir, dentries[i]) != DIRLEN)
+			results[i] = TITLEPRESENT;
+		for (u32 j = 0; j < i && results[i] == SUCCESS; ++j)
+		{
+			if (results[j] == SUCCESS && !memcmp(dentries[j].Gamecode, dentries[i].Gamecode, 4) &&
+				!memcmp(dentries[j].Filename, dentries[i].Filename, DENTRY_STRLEN))
+			{
+				results[i] = TITLEPRESENT;
+			}
+		}
+
+		if (results[i] == SUCCESS)
+			totalBlocks += BE16(dentries[i].BlockCount);
+		else if (result == SUCCESS)
+			result = results[i];
+		// nothing is imported then, the rest is only checked
+		if (result != SUCCESS || totalBlocks > BE16(CurrentBat->FreeBlocks))
+			std::vector<GCMBlock>().swap(saves[i]);
+	}
+	if (result != SUCCESS)
+		return result;
+
+	if (m_dirIndex.NumFiles + inputFiles.size() > DIRLEN)
+		return OUTOFDIRENTRIES;
+	// the blocks importing the files one after the other would use
+	std::vector<u16> blocks;
+	if (totalBlocks > BE16(CurrentBat->FreeBlocks) ||
+		!m_freeBlocks.FindFreeBlocks(BE16(CurrentBat->LastAllocated), totalBlocks, blocks))
+	{
+		return OUTOFBLOCKS;
+	}
+
+	// every file goes into the same copies of the directory and BAT, which
+	// become the next generation of both at the end
+	Directory UpdatedDir = *CurrentDir;
+	BlockAlloc UpdatedBat = *CurrentBat;
+	std::vector<const GCMBlock*> saveBlocks;
+	for (u32 i = 0, first = 0; i < inputFiles.size(); ++i)
+	{
+		saveBlocks.resize(saves[i].size());
+		for (u32 j = 0; j < saves[i].size(); ++j)
+			saveBlocks[j] = &saves[i][j];
+		AddFile(UpdatedDir, UpdatedBat, dentries[i], saveBlocks, saveBlocks.empty() ? NULL : &blocks[first]);
+		first += (u32)saveBlocks.size();
+	}
 
+	if (!inputFiles.empty())
+		CommitDirBat(UpdatedDir, UpdatedBat);
 	return SUCCESS;
 }
 
@@ -935,14 +1785,15 @@ u32 GCMemcard::RemoveFile(u8 index) //index in the directory array
 	if (index >= DIRLEN)
 		return DELETE_FAIL;
 
-	u16 startingblock = BE16(dir.Dir[index].FirstBlock);
-	u16 numberofblocks = BE16(dir.Dir[index].BlockCount);
+	u16 startingblock = BE16(CurrentDir->Dir[index].FirstBlock);
+	u16 numberofblocks = BE16(CurrentDir->Dir[index].BlockCount);
 
 	BlockAlloc UpdatedBat = *CurrentBat;
-	if (!UpdatedBat.ClearBlocks(startingblock, numberofblocks))
+	if (!UpdatedBat.ClearBlocks(startingblock, numberofblocks, m_freeBlocks))
 		return DELETE_FAIL;
 	UpdatedBat.UpdateCounter = BE16(BE16(UpdatedBat.UpdateCounter) + 1);
 	*PreviousBat = UpdatedBat;
+	MarkDirty(PreviousBat);
 	if (PreviousBat == &bat )
 	{
 		CurrentBat = &bat;
@@ -976,9 +1827,11 @@ u32 GCMemcard::RemoveFile(u8 index) //index in the directory array
 		PreviousDir = &dir;
 	}
 	*/
+	m_dirIndex.Remove(UpdatedDir, index);
 	memset(&(UpdatedDir.Dir[index]), 0xFF, DENTRY_SIZE);
 	UpdatedDir.UpdateCounter = BE16(BE16(UpdatedDir.UpdateCounter) + 1);
 	*PreviousDir = UpdatedDir;
+	MarkDirty(PreviousDir);
 	if (PreviousDir == &dir )
 	{
 		CurrentDir = &dir;
@@ -993,6 +1846,114 @@ u32 GCMemcard::RemoveFile(u8 index) //index in the directory array
 	return SUCCESS;
 }
 
+u32 GCMemcard::Defragment(u16 &movedBlocks, u8 &movedFiles)
+{
+	movedBlocks = 0;
+	movedFiles = 0;
+	if (!m_valid)
+		return NOMEMCARD;
+
+	// (first block, directory index) of every file, in block order. Files
+	// without blocks have nothing to move
+	std::vector<std::pair<u16, u8> > files;
+	std::vector<u8> emptyFiles;
+	for (u8 i = 0; i < m_dirIndex.NumFiles; ++i)
+	{
+		u8 index = m_dirIndex.Files[i];
+		if (BE16(CurrentDir->Dir[index].BlockCount) == 0)
+		{
+			emptyFiles.push_back(index);
+			continue;
+		}
+		files.push_back(std::make_pair(BE16(CurrentDir->Dir[index].FirstBlock), index));
+	}
+	std::sort(files.begin(), files.end());
+
+	// the block each block of the new layout comes from. Nothing is
+	// changed unless every chain is intact
+	std::vector<bool> used(maxBlock, false);
+	std::vector<u16> source;
+	for (u32 i = 0; i < files.size(); ++i)
+	{
+		u16 block = files[i].first;
+		u16 blockCount = BE16(CurrentDir->Dir[files[i].second].BlockCount);
+		for (u16 j = 0; j < blockCount; ++j)
+		{
+			if (block < MC_FST_BLOCKS || block >= maxBlock || used[block])
+				return FAIL;
+			used[block] = true;
+			source.push_back(block);
+			block = CurrentBat->GetNextBlock(block);
+		}
+		if (block != 0xFFFF)
+			return FAIL;
+	}
+
+	// a block may be overwritten before it's moved itself, so everything
+	// that moves is read first. A file that's already where it belongs
+	// isn't touched
+	std::vector<GCMBlock> moved;
+	for (u32 i = 0, first = 0; i < files.size(); ++i)
+	{
+		u16 blockCount = BE16(CurrentDir->Dir[files[i].second].BlockCount);
+		bool fileMoved = false;
+		for (u32 j = first; j < first + blockCount; ++j)
+		{
+			if (source[j] != MC_FST_BLOCKS + j)
+			{
+				moved.push_back(GetDataBlock(source[j]));
+				fileMoved = true;
+			}
+		}
+		if (fileMoved)
+			++movedFiles;
+		first += blockCount;
+	}
+	if (moved.empty())
+		return SUCCESS;
+
+	movedBlocks = (u16)moved.size();
+	for (u16 i = 0, m = 0; i < source.size(); ++i)
+		if (source[i] != MC_FST_BLOCKS + i)
+			GetDataBlockForWrite(MC_FST_BLOCKS + i) = moved[m++];
+
+	Directory UpdatedDir = *CurrentDir;
+	BlockAlloc UpdatedBat = *CurrentBat;
+	memset(UpdatedBat.Map, 0, sizeof(UpdatedBat.Map));
+	u16 block = MC_FST_BLOCKS;
+	for (u32 i = 0; i < files.size(); ++i)
+	{
+		DEntry &entry = UpdatedDir.Dir[files[i].second];
+		u16 blockCount = BE16(entry.BlockCount);
+		*(u16*)&entry.FirstBlock = BE16(block);
+		for (u16 j = 0; j < blockCount; ++j, ++block)
+			UpdatedBat.Map[block - MC_FST_BLOCKS] = BE16((j == blockCount - 1) ? 0xFFFF : block + 1);
+	}
+	// whatever their first block was now belongs to another file
+	for (u32 i = 0; i < emptyFiles.size(); ++i)
+		*(u16*)&UpdatedDir.Dir[emptyFiles[i]].FirstBlock = 0xFFFF;
+	UpdatedBat.FreeBlocks = BE16(maxBlock - block);
+	UpdatedBat.LastAllocated = BE16(block - 1);
+
+	// The old directory and BAT point at blocks that were overwritten, they
+	// can't be left as the backups. The copy with the higher update counter
+	// stays the current one
+	*CurrentDir = UpdatedDir;
+	UpdatedDir.UpdateCounter = BE16(BE16(UpdatedDir.UpdateCounter) + 1);
+	*PreviousDir = UpdatedDir;
+	MarkDirty(&dir);
+	MarkDirty(&dir_backup);
+
+	*CurrentBat = UpdatedBat;
+	UpdatedBat.UpdateCounter = BE16(BE16(UpdatedBat.UpdateCounter) + 1);
+	*PreviousBat = UpdatedBat;
+	MarkDirty(&bat);
+	MarkDirty(&bat_backup);
+
+	SetCurrentDirBatInternal();
+	return SUCCESS;
+}
+
 u32 GCMemcard::CopyFrom(const GCMemcard& source, u8 index)
 {
 	if (!m_valid || !source.m_valid)
@@ -1005,9 +1966,10 @@ u32 GCMemcard::CopyFrom(const GCMemcard& source, u8 index)
 	u32 size = source.DEntry_BlockCount(index);
 	if (size == 0xFFFF) return INVALIDFILESIZE;
 
-	std::vector<GCMBlock> saveData;
+	// copied from the source card's blocks to this card's
+	std::vector<const GCMBlock*> saveData;
 	saveData.reserve(size);
-	switch (source.GetSaveData(index, saveData))
+	switch (source.GetSaveBlocks(index, saveData))
 	{
 	case FAIL:
 		return FAIL;
@@ -1020,120 +1982,241 @@ u32 GCMemcard::CopyFrom(const GCMemcard& source, u8 index)
 
 u32 GCMemcard::ImportGci(const char *inputFile, const std::string &outputFile)
 {
-	if (outputFile.empty() && !m_valid)
+	if (!outputFile.empty())
+	{
+		// only converted, the card isn't used
+		u32 result = ConvertSave(inputFile, outputFile, GCI);
+		return result == SUCCESS ? GCS : result;
+	}
+
+	if (!m_valid)
 		return OPENFAIL;
 
 	File::IOFile gci(inputFile, "rb");
 	if (!gci)
 		return OPENFAIL;
 
-	u32 result = ImportGciInternal(gci.ReleaseHandle(), inputFile, outputFile);
+	u32 result = ImportGciInternal(gci.ReleaseHandle(), inputFile);
 
 	return result;
 }
 
-u32 GCMemcard::ImportGciInternal(FILE* gcih, const char *inputFile, const std::string &outputFile)
+u32 GCMemcard::ImportGciInternal(FILE* gcih, const char *inputFile)
 {
 	File::IOFile gci(gcih);
-	unsigned int offset;
-	char tmp[0xD];
+	DEntry tempDEntry;
+	std::vector<GCMBlock> saveData;
+	u32 ret = ReadGci(gci, inputFile, tempDEntry, saveData);
+	if (ret != SUCCESS)
+		return ret;
+
+	return ImportFile(tempDEntry, saveData);
+}
+
+u32 GCMemcard::ReadGci(File::IOFile &gci, const std::string &inputFile, DEntry &tempDEntry, std::vector<GCMBlock> &saveData)
+{
+	u32 offset, length;
+	u32 ret = GetGciLayout(gci, inputFile, offset, length);
+	if (ret != SUCCESS)
+		return ret;
+
+	// the save fills the file after the DEntry, so the header, the DEntry
+	// and the save are all read with one call
+	u8 header[GCS];
+	saveData.resize(length / BLOCK_SIZE);
+	File::IOFile::Buffer buffers[3] = {
+		{ header, offset },
+		{ &tempDEntry, DENTRY_SIZE },
+		{ saveData.empty() ? NULL : saveData[0].block, length },
+	};
+	if (!gci.ReadVector(buffers, 3, 0))
+		return OPENFAIL;
+
+	return CheckGciHeader(offset, header, tempDEntry, length);
+}
+
+u32 GCMemcard::GetGciLayout(File::IOFile &gci, const std::string &fileName, u32 &offset, u32 &length)
+{
+	if (!GetSaveType(fileName, offset))
+		return OPENFAIL;
+
+	const u64 fileSize = gci.GetSize();
+	if (fileSize < offset + DENTRY_SIZE || fileSize - offset - DENTRY_SIZE > (u64)MemCard2043Mb * MBIT_TO_BLOCKS * BLOCK_SIZE)
+		return LENGTHFAIL;
+	length = (u32)(fileSize - offset - DENTRY_SIZE);
+	if (length % BLOCK_SIZE)
+		return LENGTHFAIL;
+	return SUCCESS;
+}
+
+bool GCMemcard::GetSaveType(const std::string &fileName, u32 &saveType)
+{
 	std::string fileType;
-	SplitPath(inputFile, NULL, NULL, &fileType);
+	SplitPath(fileName, NULL, NULL, &fileType);
 
 	if (!strcasecmp(fileType.c_str(), ".gci"))
-		offset = GCI;
+		saveType = GCI;
+	else if (!strcasecmp(fileType.c_str(), ".gcs"))
+		saveType = GCS;
+	else if (!strcasecmp(fileType.c_str(), ".sav"))
+		saveType = SAV;
 	else
-	{
-		gci.ReadBytes(tmp, 0xD);
-		if (!strcasecmp(fileType.c_str(), ".gcs"))
-		{
-			if (!memcmp(tmp, "GCSAVE", 6))	// Header must be uppercase
-				offset = GCS;
-			else
-				return GCSFAIL;
-		}
-		else if (!strcasecmp(fileType.c_str(), ".sav"))
-		{
-			if (!memcmp(tmp, "DATELGC_SAVE", 0xC)) // Header must be uppercase
-				offset = SAV;
-			else
-				return SAVFAIL;
-		}
-		else
-			return OPENFAIL;
-	}
-	gci.Seek(offset, SEEK_SET);
+		return false;
+	return true;
+}
 
-	DEntry tempDEntry;
-	gci.ReadBytes(&tempDEntry, DENTRY_SIZE);
-	const u32 fStart = (u32)gci.Tell();
-	gci.Seek(0, SEEK_END);
-	const u32 length = (u32)gci.Tell() - fStart;
-	gci.Seek(offset + DENTRY_SIZE, SEEK_SET);
+u32 GCMemcard::CheckGciHeader(u32 offset, const u8 *header, DEntry &tempDEntry, u32 length)
+{
+	if (offset == GCS && memcmp(header, "GCSAVE", 6))	// Header must be uppercase
+		return GCSFAIL;
+	if (offset == SAV && memcmp(header, "DATELGC_SAVE", 0xC)) // Header must be uppercase
+		return SAVFAIL;
 
 	Gcs_SavConvert(tempDEntry, offset, length);
 
 	if (length != ((u32)BE16(tempDEntry.BlockCount) * BLOCK_SIZE))
 		return LENGTHFAIL;
-	if (gci.Tell() != offset + DENTRY_SIZE) // Verify correct file position
-		return OPENFAIL;
-	
-	u32 size = BE16((tempDEntry.BlockCount));
-	std::vector<GCMBlock> saveData;
-	saveData.reserve(size);
+	return SUCCESS;
+}
 
-	for (u32 i = 0; i < size; ++i)
+void GCMemcard::MakeGciHeader(int saveType, u8 *header)
+{
+	memset(header, 0, GCS);
+	switch(saveType)
 	{
-		GCMBlock b;
-		gci.ReadBytes(b.block, BLOCK_SIZE);
-		saveData.push_back(b);
+	case GCS:
+		memcpy(header, "GCSAVE", 6);
+		break;
+
+	case SAV:
+		memcpy(header, "DATELGC_SAVE", 0xC);
+		break;
 	}
-	u32 ret;
-	if (!outputFile.empty())
-	{
-		File::IOFile gci2(outputFile, "wb");
-		bool completeWrite = true;
-		if (!gci2)
-		{
-			return OPENFAIL;
-		}
-		gci2.Seek(0, SEEK_SET);
+}
+
+// ConvertSave copies 128 KiB at a time
+static const u32 CONVERT_BUFFER_BLOCKS = 16;
+
+u32 GCMemcard::ConvertSave(const std::string &inputFile, const std::string &outputFile)
+{
+	u32 saveType;
+	if (!GetSaveType(outputFile, saveType))
+		return OPENFAIL;
+	return ConvertSave(inputFile, outputFile, saveType);
+}
+
+u32 GCMemcard::ConvertSave(const std::string &inputFile, const std::string &outputFile, u32 saveType)
+{
+	// there would be nothing to convert
+	if (File::IsSameFile(inputFile, outputFile))
+		return OPENFAIL;
+
+	File::IOFile in(inputFile, "rb");
+	if (!in)
+		return OPENFAIL;
+
+	u32 offset, length;
+	u32 ret = GetGciLayout(in, inputFile, offset, length);
+	if (ret != SUCCESS)
+		return ret;
+
+	u8 header[GCS];
+	DEntry tempDEntry;
+	File::IOFile::Buffer buffers[2] = {
+		{ header, offset },
+		{ &tempDEntry, DENTRY_SIZE },
+	};
+	if (!in.ReadVector(buffers, 2, 0))
+		return OPENFAIL;
+	ret = CheckGciHeader(offset, header, tempDEntry, length);
+	if (ret != SUCCESS)
+		return ret;
+
+	// written next to the output file and renamed over it when complete,
+	// like Save, an existing file is only replaced by a complete one
+	const std::string tempName = outputFile + ".tmp";
+	File::IOFile out(tempName, "wb");
+	if (!out)
+		return OPENFAIL;
 
-		if (!gci2.WriteBytes(&tempDEntry, DENTRY_SIZE)) 
-			completeWrite = false;
-		int fileBlocks = BE16(tempDEntry.BlockCount);
-		gci2.Seek(DENTRY_SIZE, SEEK_SET);
+	// the same DEntry ExportGci would write
+	MakeGciHeader(saveType, header);
+	Gcs_SavConvert(tempDEntry, saveType);
+	buffers[0].length = saveType;
+	bool written = out.WriteVector(buffers, 2, 0);
 
-		for (int i = 0; i < fileBlocks; ++i)
+	// the save itself is the same in every format, it's copied through
+	// a buffer of a few blocks
+	std::vector<u8> buffer(CONVERT_BUFFER_BLOCKS * BLOCK_SIZE);
+	u64 inPosition = offset + DENTRY_SIZE, outPosition = saveType + DENTRY_SIZE;
+	while (written && length)
+	{
+		File::IOFile::Buffer data = { &buffer[0], std::min<u32>(length, (u32)buffer.size()) };
+		if (!in.ReadVector(&data, 1, inPosition))
 		{
-			if (!gci2.WriteBytes(saveData[i].block, BLOCK_SIZE))
-			completeWrite = false;
+			out.Close();
+			File::Delete(tempName);
+			return READFAIL;
 		}
+		written = out.WriteVector(&data, 1, outPosition);
+		inPosition += data.length;
+		outPosition += data.length;
+		length -= (u32)data.length;
+	}
 
-		if (completeWrite)
-			ret = GCS;
-		else
-			ret = WRITEFAIL;
+	in.Close();
+	if (!written || !out.Close() || !File::Rename(tempName, outputFile))
+	{
+		out.Close();
+		File::Delete(tempName);
+		return WRITEFAIL;
 	}
-	else 
-		ret = ImportFile(tempDEntry, saveData);
+	return SUCCESS;
+}
 
-	return ret;
+u32 GCMemcard::ConvertSaves(const std::string &inputDirectory, const std::string &outputDirectory,
+	const std::string &extension, std::vector<std::string> &fileNames, std::vector<u32> &results)
+{
+	CFileSearch::XStringVector extensions, directories;
+	extensions.push_back("*.gci");
+	extensions.push_back("*.gcs");
+	extensions.push_back("*.sav");
+	directories.push_back(inputDirectory);
+	CFileSearch search(extensions, directories);
+
+	fileNames = search.GetFileNames();
+	results.assign(fileNames.size(), SUCCESS);
+	File::CreateFullPath(outputDirectory + DIR_SEP);
+
+	u32 result = SUCCESS;
+	for (u32 i = 0; i < fileNames.size(); ++i)
+	{
+		std::string name;
+		SplitPath(fileNames[i], NULL, &name, NULL);
+		const std::string outputFile = outputDirectory + DIR_SEP + name + extension;
+		// already what it would be converted to
+		if (File::IsSameFile(fileNames[i], outputFile))
+			continue;
+		results[i] = ConvertSave(fileNames[i], outputFile);
+		if (results[i] != SUCCESS && result == SUCCESS)
+			result = results[i];
+	}
+	return result;
 }
 
 u32 GCMemcard::ExportGci(u8 index, const char *fileName, const std::string &directory) const
 {
-	File::IOFile gci;
+	std::string gciPath;
 	int offset = GCI;
 	if (!fileName)
 	{
 		std::string gciFilename;
 		if (!GCI_FileName(index, gciFilename)) return SUCCESS;
-		gci.Open(directory + DIR_SEP + gciFilename, "wb");
+		gciPath = directory + DIR_SEP + gciFilename;
 	}
 	else
 	{
-		gci.Open(fileName, "wb");
+		gciPath = fileName;
 
 		std::string fileType;
 		SplitPath(fileName, NULL, NULL, &fileType);
@@ -1147,36 +2230,43 @@ u32 GCMemcard::ExportGci(u8 index, const char *fileName, const std::string &dire
 		}
 	}
 
+	// the header, the DEntry and the save are written with one call
+	u8 header[GCS];
+	MakeGciHeader(offset, header);
+	std::vector<File::IOFile::Buffer> buffers;
+	File::IOFile::Buffer headerBuffer = { header, (size_t)offset };
+	buffers.push_back(headerBuffer);
+
+	// an existing file is left alone unless the save can be exported
+	DEntry tempDEntry;
+	u32 result = GetExportBuffers(index, offset, tempDEntry, buffers);
+	if (result != SUCCESS)
+		return result;
+
+	// written next to the .gci and renamed over it when complete, like ConvertSave
+	const std::string tempName = gciPath + ".tmp";
+	File::IOFile gci(tempName, "wb");
 	if (!gci)
 		return OPENFAIL;
-
-	gci.Seek(0, SEEK_SET);
-	
-	switch(offset)
+	if (!gci.WriteVector(&buffers[0], buffers.size(), 0) || !gci.Close() || !File::Rename(tempName, gciPath))
 	{
-	case GCS:
-		u8 gcsHDR[GCS];
-		memset(gcsHDR, 0, GCS);
-		memcpy(gcsHDR, "GCSAVE", 6);
-		gci.WriteArray(gcsHDR, GCS);
-		break;
-
-	case SAV:
-		u8 savHDR[SAV];
-		memset(savHDR, 0, SAV);
-		memcpy(savHDR, "DATELGC_SAVE", 0xC);
-		gci.WriteArray(savHDR, SAV);
-		break;
+		gci.Close();
+		File::Delete(tempName);
+		return WRITEFAIL;
 	}
+	return SUCCESS;
+}
 
-	DEntry tempDEntry;
-	if (!GetDEntry(index, tempDEntry))
+u32 GCMemcard::GetExportBuffers(u8 index, int saveType, DEntry &dentry, std::vector<File::IOFile::Buffer> &buffers) const
+{
+	if (!GetDEntry(index, dentry))
 	{
 		return NOMEMCARD;
 	}
 
-	Gcs_SavConvert(tempDEntry, offset);
-	gci.WriteBytes(&tempDEntry, DENTRY_SIZE);
+	Gcs_SavConvert(dentry, saveType);
+	File::IOFile::Buffer dentryBuffer = { &dentry, DENTRY_SIZE };
+	buffers.push_back(dentryBuffer);
 
 	u32 size = DEntry_BlockCount(index);
 	if (size == 0xFFFF)
@@ -1184,26 +2274,218 @@ u32 GCMemcard::ExportGci(u8 index, const char *fileName, const std::string &dire
 		return FAIL;
 	}
 
-	std::vector<GCMBlock> saveData;
+	std::vector<const GCMBlock*> saveData;
 	saveData.reserve(size);
 
-	switch(GetSaveData(index, saveData))
+	switch(GetSaveBlocks(index, saveData))
 	{
 	case FAIL:
 		return FAIL;
 	case NOMEMCARD:
 		return NOMEMCARD;
 	}
-	gci.Seek(DENTRY_SIZE + offset, SEEK_SET);
-	for (u32 i = 0; i < size; ++i)
+	// blocks that follow each other in memory (a mapped or fully loaded
+	// card) are a single buffer
+	for (u32 i = 0; i < size;)
 	{
-		gci.WriteBytes(saveData[i].block, BLOCK_SIZE);
+		u32 run = 1;
+		while (i + run < size && saveData[i + run - 1]->block + BLOCK_SIZE == saveData[i + run]->block)
+			++run;
+		File::IOFile::Buffer blockBuffer = { const_cast<u8*>(saveData[i]->block), run * BLOCK_SIZE };
+		buffers.push_back(blockBuffer);
+		i += run;
 	}
+	return SUCCESS;
+}
 
-	if (gci.IsGood())
-		return SUCCESS;
+// ExportAll's writer threads, each takes the next .gci that isn't written
+// yet until there are none left
+struct GciWriter
+{
+	std::string directory;
+	const std::vector<std::vector<File::IOFile::Buffer> > *saves;
+	GCMemcard::ExportReport *report;
+	std::mutex lock;
+	u32 next;
+
+	static void WorkerThread(GciWriter *writer)
+	{
+		Common::SetCurrentThreadName("GCI writer");
+
+		while (true)
+		{
+			u32 i;
+			{
+				std::lock_guard<std::mutex> lk(writer->lock);
+				if (writer->next >= writer->saves->size())
+					return;
+				i = writer->next++;
+			}
+
+			// each thread only writes the result of the save it took
+			GCMemcard::ExportReport::Save &save = writer->report->saves[i];
+			if (save.result != SUCCESS)
+				continue;
+			const std::vector<File::IOFile::Buffer> &buffers = (*writer->saves)[i];
+			const std::string fileName = writer->directory + DIR_SEP + save.fileName;
+			File::IOFile gci(fileName, "wb");
+			if (!gci)
+				save.result = OPENFAIL;
+			else if (!gci.WriteVector(&buffers[0], buffers.size(), 0) || !gci.Close())
+			{
+				save.result = WRITEFAIL;
+				gci.Close();
+				File::Delete(fileName);
+			}
+		}
+	}
+};
+
+u32 GCMemcard::ExportAll(const std::string &directory, ExportReport &report, u32 numThreads) const
+{
+	report.saves.clear();
+	report.numExported = 0;
+	report.elapsedMs = 0;
+	if (!m_valid)
+		return NOMEMCARD;
+
+	u32 startTime = Common::Timer::GetTimeMs();
+
+	// everything the writers need is taken from the card first, they only
+	// read the DEntries copied here and the card's blocks
+	const u8 numFiles = GetNumFiles();
+	std::vector<DEntry> dentries(numFiles);
+	std::vector<std::vector<File::IOFile::Buffer> > saves(numFiles);
+	report.saves.resize(numFiles);
+	for (u8 i = 0; i < numFiles; ++i)
+	{
+		ExportReport::Save &save = report.saves[i];
+		save.index = GetFileIndex(i);
+		GCI_FileName(save.index, save.fileName);
+		save.result = GetExportBuffers(save.index, GCI, dentries[i], saves[i]);
+	}
+
+	std::string extension;
+	SplitPath(directory, NULL, NULL, &extension);
+	u32 result = SUCCESS;
+	if (!strcasecmp(extension.c_str(), ".tar"))
+	{
+		result = ExportTar(directory, report, saves);
+	}
 	else
-		return WRITEFAIL;
+	{
+		File::CreateFullPath(directory + DIR_SEP);
+
+		// the writers mostly wait for the disk, a few are enough
+		if (numThreads == 0)
+			numThreads = std::min<u32>(std::max<u32>(std::thread::hardware_concurrency(), 1), 4);
+		if (numThreads > numFiles)
+			numThreads = numFiles;
+
+		GciWriter writer;
+		writer.directory = directory;
+		writer.saves = &saves;
+		writer.report = &report;
+		writer.next = 0;
+		std::vector<std::thread*> threads;
+		for (u32 i = 0; i < numThreads; ++i)
+			threads.push_back(new std::thread(&GciWriter::WorkerThread, &writer));
+		for (u32 i = 0; i < threads.size(); ++i)
+		{
+			threads[i]->join();
+			delete threads[i];
+		}
+	}
+
+	for (u32 i = 0; i < report.saves.size(); ++i)
+	{
+		if (report.saves[i].result == SUCCESS)
+			++report.numExported;
+		else if (result == SUCCESS)
+			result = report.saves[i].result;
+	}
+	report.elapsedMs = Common::Timer::GetTimeMs() - startTime;
+	return result;
+}
+
+u32 GCMemcard::ExportTar(const std::string &fileName, ExportReport &report,
+	const std::vector<std::vector<File::IOFile::Buffer> > &saves) const
+{
+	// a ustar header before every .gci, each file padded to the 512 byte
+	// records of the format, and two empty records at the end
+	const u32 TAR_RECORD = 512;
+	// tar wants unix time, DEntries count from 2000-01-01
+	const u32 UNIX_TIME_2000 = 946684800;
+	static u8 padding[2 * TAR_RECORD];
+
+	std::vector<u8> headers(saves.size() * TAR_RECORD, 0);
+	std::vector<File::IOFile::Buffer> buffers;
+	for (u32 i = 0; i < saves.size(); ++i)
+	{
+		const ExportReport::Save &save = report.saves[i];
+		if (save.result != SUCCESS)
+			continue;
+
+		u64 size = 0;
+		for (u32 j = 0; j < saves[i].size(); ++j)
+			size += saves[i][j].length;
+
+		char *header = (char*)&headers[i * TAR_RECORD];
+		strncpy(header, save.fileName.c_str(), 99);
+		sprintf(header + 100, "%07o", 0644);
+		sprintf(header + 108, "%07o", 0);
+		sprintf(header + 116, "%07o", 0);
+		sprintf(header + 124, "%011llo", (unsigned long long)size);
+		sprintf(header + 136, "%011o", DEntry_ModTime(save.index) + UNIX_TIME_2000);
+		header[156] = '0';
+		memcpy(header + 257, "ustar", 6);
+		memcpy(header + 263, "00", 2);
+		// the checksum is taken with its own field as spaces
+		memset(header + 148, ' ', 8);
+		u32 checksum = 0;
+		for (u32 j = 0; j < TAR_RECORD; ++j)
+			checksum += (u8)header[j];
+		sprintf(header + 148, "%06o", checksum);
+
+		File::IOFile::Buffer headerBuffer = { header, TAR_RECORD };
+		buffers.push_back(headerBuffer);
+		buffers.insert(buffers.end(), saves[i].begin(), saves[i].end());
+		if (size % TAR_RECORD)
+		{
+			File::IOFile::Buffer paddingBuffer = { padding, TAR_RECORD - size % TAR_RECORD };
+			buffers.push_back(paddingBuffer);
+		}
+	}
+	File::IOFile::Buffer endBuffer = { padding, sizeof(padding) };
+	buffers.push_back(endBuffer);
+
+	// the directory is created like the one .gci files are exported to
+	std::string tarDirectory;
+	SplitPath(fileName, &tarDirectory, NULL, NULL);
+	if (!tarDirectory.empty())
+		File::CreateFullPath(tarDirectory);
+
+	// written next to the tar and renamed over it when complete, like Save
+	const std::string tempName = fileName + ".tmp";
+	File::IOFile tarFile(tempName, "wb");
+	u32 result = SUCCESS;
+	if (!tarFile)
+		result = OPENFAIL;
+	else if (!tarFile.WriteVector(&buffers[0], buffers.size(), 0) || !tarFile.Close() ||
+		!File::Rename(tempName, fileName))
+	{
+		result = WRITEFAIL;
+	}
+
+	if (result != SUCCESS)
+	{
+		tarFile.Close();
+		File::Delete(tempName);
+		for (u32 i = 0; i < report.saves.size(); ++i)
+			if (report.saves[i].result == SUCCESS)
+				report.saves[i].result = result;
+	}
+	return result;
 }
 
 void GCMemcard::Gcs_SavConvert(DEntry &tempDEntry, int saveType, u32 length)
@@ -1258,27 +2540,33 @@ bool GCMemcard::ReadBannerRGBA8(u8 index, u32* buffer) const
 		return false;
 
 	u32 DataOffset = BE32(CurrentDir->Dir[index].ImageOffset);
-	u16 DataBlock = BE16(CurrentDir->Dir[index].FirstBlock) - MC_FST_BLOCKS;
+	u16 DataBlock = BE16(CurrentDir->Dir[index].FirstBlock);
 
-	if ((DataBlock > maxBlock) || (DataOffset == 0xFFFFFFFF))
+	if ((DataBlock < MC_FST_BLOCKS) || (DataBlock >= maxBlock) || (DataOffset == 0xFFFFFFFF))
 	{
 		return false;
 	}
 
 	const int pixels = 96*32;
+	// big enough for either format, the banner can span two blocks
+	u16 bannerData[pixels];
 
 	if (bnrFormat&1)
 	{
-		u8  *pxdata  = (u8* )(mc_data_blocks[DataBlock].block + DataOffset);
-		u16 *paldata = (u16*)(mc_data_blocks[DataBlock].block + DataOffset + pixels);
+		u8  *pxdata  = (u8* )bannerData;
+		u16 *paldata = (u16*)(pxdata + pixels);
 
-		decodeCI8image(buffer, pxdata, paldata, 96, 32);
+		if (!ReadSaveData(index, DataOffset, pixels + 2*256, pxdata))
+			return false;
+		ColorUtil::decodeCI8image(buffer, pxdata, paldata, 96, 32);
 	}
 	else
 	{
-		u16 *pxdata = (u16*)(mc_data_blocks[DataBlock].block + DataOffset);
+		u16 *pxdata = bannerData;
 
-		decode5A3image(buffer, pxdata, 96, 32);
+		if (!ReadSaveData(index, DataOffset, pixels*2, (u8*)pxdata))
+			return false;
+		ColorUtil::decode5A3image(buffer, pxdata, 96, 32);
 	}
 	return true;
 }
@@ -1305,28 +2593,32 @@ u32 GCMemcard::ReadAnimRGBA8(u8 index, u32* buffer, u8 *delays) const
 	int bnrFormat = (flags&3);
 
 	u32 DataOffset = BE32(CurrentDir->Dir[index].ImageOffset);
-	u16 DataBlock = BE16(CurrentDir->Dir[index].FirstBlock) - MC_FST_BLOCKS;
+	u16 DataBlock = BE16(CurrentDir->Dir[index].FirstBlock);
 
-	if ((DataBlock > maxBlock) || (DataOffset == 0xFFFFFFFF))
+	if ((DataBlock < MC_FST_BLOCKS) || (DataBlock >= maxBlock) || (DataOffset == 0xFFFFFFFF))
 	{
 		return 0;
 	}
 
-	u8* animData = (u8*)(mc_data_blocks[DataBlock].block + DataOffset);
-
 	switch (bnrFormat)
 	{
 	case 1:
-		animData += 96*32 + 2*256; // image+palette
+		DataOffset += 96*32 + 2*256; // image+palette
 		break;
 	case 2:
-		animData += 96*32*2;
+		DataOffset += 96*32*2;
 		break;
 	}
 
+	// The frames usually span several blocks, they are copied here once the
+	// length of all of them is known. 8 RGB5A3 frames are the largest.
+	u16 animBuffer[8*32*32];
+	u8* animData = (u8*)animBuffer;
+
 	int fmts[8];
 	u8* data[8];
 	int frames = 0;
+	bool sharedPalette = false;
 
 	for (int i = 0; i < 8; i++)
 	{
@@ -1347,6 +2639,7 @@ u32 GCMemcard::ReadAnimRGBA8(u8 index, u32* buffer, u8 *delays) const
 			{
 			case CI8SHARED: // CI8 with shared palette
 				animData += 32*32;
+				sharedPalette = true;
 				break;
 			case RGB5A3: // RGB5A3
 				animData += 32*32*2;
@@ -1358,7 +2651,16 @@ u32 GCMemcard::ReadAnimRGBA8(u8 index, u32* buffer, u8 *delays) const
 		}
 	}
 
-	u16* sharedPal = (u16*)(animData);
+	u32 length = (u32)(animData - (u8*)animBuffer) + (sharedPalette ? 2*256 : 0);
+	if (!ReadSaveData(index, DataOffset, length, (u8*)animBuffer))
+		return 0;
+
+	// the shared palette is decoded once for all the frames using it,
+	// the others have theirs decoded for each frame
+	u32 sharedPal[256];
+	u32 palette[256];
+	if (sharedPalette)
+		ColorUtil::decodePalette(sharedPal, (u16*)(animData));
 	int j = 0;
 
 	for (int i = 0; i < 8; i++)
@@ -1374,16 +2676,16 @@ u32 GCMemcard::ReadAnimRGBA8(u8 index, u32* buffer, u8 *delays) const
 			switch (fmts[i])
 			{
 			case CI8SHARED: // CI8 with shared palette
-				decodeCI8image(buffer,data[i],sharedPal,32,32);
+				ColorUtil::decodeCI8image(buffer,data[i],sharedPal,32,32);
 				buffer += 32*32;
 				break;
 			case RGB5A3: // RGB5A3
-				decode5A3image(buffer, (u16*)(data[i]), 32, 32);
+				ColorUtil::decode5A3image(buffer, (u16*)(data[i]), 32, 32);
 				buffer += 32*32;
 				break;
 			case CI8: // CI8 with own palette
-				u16 *paldata = (u16*)(data[i] + 32*32);
-				decodeCI8image(buffer, data[i], paldata, 32, 32);
+				ColorUtil::decodePalette(palette, (u16*)(data[i] + 32*32));
+				ColorUtil::decodeCI8image(buffer, data[i], palette, 32, 32);
 				buffer += 32*32;
 				break;
 			}
@@ -1400,15 +2702,15 @@ u32 GCMemcard::ReadAnimRGBA8(u8 index, u32* buffer, u8 *delays) const
 					switch (fmts[j])
 					{
 					case CI8SHARED: // CI8 with shared palette
-						decodeCI8image(buffer,data[j],sharedPal,32,32);
+						ColorUtil::decodeCI8image(buffer,data[j],sharedPal,32,32);
 						break;
 					case RGB5A3: // RGB5A3
-						decode5A3image(buffer, (u16*)(data[j]), 32, 32);
+						ColorUtil::decode5A3image(buffer, (u16*)(data[j]), 32, 32);
 						buffer += 32*32;
 						break;
 					case CI8: // CI8 with own palette
-						u16 *paldata = (u16*)(data[j] + 32*32);
-						decodeCI8image(buffer, data[j], paldata, 32, 32);
+						ColorUtil::decodePalette(palette, (u16*)(data[j] + 32*32));
+						ColorUtil::decodeCI8image(buffer, data[j], palette, 32, 32);
 						buffer += 32*32;
 						break;
 					}
@@ -1420,6 +2722,34 @@ u32 GCMemcard::ReadAnimRGBA8(u8 index, u32* buffer, u8 *delays) const
 	return frames;
 }
 
+u64 GCMemcard::GetImageHash(u8 index) const
+{
+	if (!m_valid)
+		return 0;
+
+	const DEntry &d = CurrentDir->Dir[index];
+	u16 blockCount = BE16(d.BlockCount);
+	if (blockCount > maxBlock)
+		return 0;
+	u32 saveLength = blockCount * BLOCK_SIZE;
+	u32 DataOffset = BE32(d.ImageOffset);
+
+	// the first block, or up to the end of the largest banner and
+	// animation there can be (RGB5A3 banner and 8 RGB5A3 frames)
+	u32 length = BLOCK_SIZE;
+	if (DataOffset != 0xFFFFFFFF && DataOffset < saveLength)
+		length = std::max<u32>(length, DataOffset + 96*32*2 + 8*32*32*2);
+	length = std::min(length, saveLength);
+
+	std::vector<u8> data(sizeof(DEntry) + length);
+	memcpy(&data[0], &d, sizeof(DEntry));
+	if (length && !ReadSaveData(index, 0, length, &data[sizeof(DEntry)]))
+		return 0;
+
+	// not GetHash64, the hash is kept on disk and that one can be switched
+	return GetMurmurHash3(&data[0], (int)data.size(), 0);
+}
+
 
 bool GCMemcard::Format(u8 * card_data, bool sjis, u16 SizeMb)
 {
@@ -1460,10 +2790,16 @@ bool GCMemcard::Format(bool sjis, u16 SizeMb)
 	*(u16*)hdr.SizeMb = BE16(SizeMb);
 	hdr.Encoding = BE16(sjis ? 1 : 0);
 	FormatInternal(gcp);
-	SetCurrentDirBatInternal();
+
+	ReleaseBackingFile(false);
 
 	m_sizeMb = SizeMb;
 	maxBlock = m_sizeMb * MBIT_TO_BLOCKS;
+	SetCurrentDirBatInternal();
+	m_dirtyBlocks.assign(maxBlock, true);
+	m_testedChecksums = 0;
+	m_syncedFileName.clear();
+	mc_data_blocks.clear();
 	mc_data_blocks.reserve(maxBlock - MC_FST_BLOCKS);
 	for (u16 i = 0; i < (maxBlock - MC_FST_BLOCKS); ++i)
 	{
@@ -1563,12 +2899,11 @@ void GCMemcard::CARD_GetSerialNo(u32 *serial1,u32 *serial2)
 /* ret: Error code                                           */
 /*************************************************************/
 
-s32 GCMemcard::FZEROGX_MakeSaveGameValid(DEntry& direntry, std::vector<GCMBlock> &FileBuffer)
+s32 GCMemcard::FZEROGX_MakeSaveGameValid(DEntry& direntry, const std::vector<GCMBlock*> &FileBuffer)
 {
 	u32 i,j;
 	u32 serial1,serial2;
 	u16 chksum = 0xFFFF;
-	int block = 0;
 
 	// check for F-Zero GX system file
 	if (strcmp((char*)direntry.Filename,"f_zero.dat")!=0) return 0;
@@ -1577,25 +2912,24 @@ s32 GCMemcard::FZEROGX_MakeSaveGameValid(DEntry& direntry, std::vector<GCMBlock>
 	CARD_GetSerialNo(&serial1,&serial2);
 
 	// set new serial numbers
-	*(u16*)&FileBuffer[1].block[0x0066] = BE16(BE32(serial1) >> 16);			
-	*(u16*)&FileBuffer[3].block[0x1580] = BE16(BE32(serial2) >> 16);
-	*(u16*)&FileBuffer[1].block[0x0060] = BE16(BE32(serial1) & 0xFFFF);
-	*(u16*)&FileBuffer[1].block[0x0200] = BE16(BE32(serial2) & 0xFFFF);
+	*(u16*)&FileBuffer[1]->block[0x0066] = BE16(BE32(serial1) >> 16);			
+	*(u16*)&FileBuffer[3]->block[0x1580] = BE16(BE32(serial2) >> 16);
+	*(u16*)&FileBuffer[1]->block[0x0060] = BE16(BE32(serial1) & 0xFFFF);
+	*(u16*)&FileBuffer[1]->block[0x0200] = BE16(BE32(serial2) & 0xFFFF);
 
-	// calc 16-bit checksum
+	// calc 16-bit checksum over the first four blocks
 	for (i=0x02;i<0x8000;i++)
 	{				
-		chksum ^= (FileBuffer[block].block[i-(block*0x2000)]&0xFF);
+		chksum ^= (FileBuffer[i / BLOCK_SIZE]->block[i % BLOCK_SIZE]&0xFF);
 		for (j=8; j > 0; j--)
 		{
 			if (chksum&1) chksum = (chksum>>1)^0x8408;
 			else chksum >>= 1;
 		}
-		if (!(i%0x2000)) block ++;
 	}
 
 	// set new checksum
-	*(u16*)&FileBuffer[0].block[0x00] = BE16(~chksum);				
+	*(u16*)&FileBuffer[0]->block[0x00] = BE16(~chksum);				
 
 	return 1;
 }
@@ -1608,7 +2942,7 @@ s32 GCMemcard::FZEROGX_MakeSaveGameValid(DEntry& direntry, std::vector<GCMBlock>
 /* ret: Error code                                         */
 /***********************************************************/
 
-s32 GCMemcard::PSO_MakeSaveGameValid(DEntry& direntry, std::vector<GCMBlock> &FileBuffer)
+s32 GCMemcard::PSO_MakeSaveGameValid(DEntry& direntry, const std::vector<GCMBlock*> &FileBuffer)
 {
 	u32 i,j;
 	u32 chksum;
@@ -1636,8 +2970,8 @@ s32 GCMemcard::PSO_MakeSaveGameValid(DEntry& direntry, std::vector<GCMBlock> &Fi
 	CARD_GetSerialNo(&serial1,&serial2);
 
 	// set new serial numbers
-	*(u32*)&FileBuffer[1].block[0x0158] = serial1;
-	*(u32*)&FileBuffer[1].block[0x015C] = serial2;
+	*(u32*)&FileBuffer[1]->block[0x0158] = serial1;
+	*(u32*)&FileBuffer[1]->block[0x015C] = serial2;
 
 	// generate crc32 LUT
 	for (i=0; i < 256; i++)
@@ -1658,11 +2992,11 @@ s32 GCMemcard::PSO_MakeSaveGameValid(DEntry& direntry, std::vector<GCMBlock> &Fi
 	// calc 32-bit checksum
 	for (i=0x004C; i < 0x0164+pso3offset; i++)
 	{		
-		chksum = ((chksum>>8)&0xFFFFFF)^crc32LUT[(chksum^FileBuffer[1].block[i])&0xFF];
+		chksum = ((chksum>>8)&0xFFFFFF)^crc32LUT[(chksum^FileBuffer[1]->block[i])&0xFF];
 	}
 
 	// set new checksum
-	*(u32*)&FileBuffer[1].block[0x0048] = BE32(chksum^0xFFFFFFFF);			
+	*(u32*)&FileBuffer[1]->block[0x0048] = BE32(chksum^0xFFFFFFFF);			
 
 	return 1;
 }
@@ -20,9 +20,11 @@
 
 #include "Common.h"
 #include "CommonPaths.h"
+#include "FileUtil.h"
 #include "Sram.h"
 #include "StringUtil.h"
 #include "IPLTime.h"//EXI_DeviceIPL.h"
+#include "MemcardCompressed.h"
 
 #define BE64(x) (Common::swap64(x))
 #define BE32(x) (Common::swap32(x))
@@ -49,6 +51,10 @@ enum
 	FAIL,
 	WRITEFAIL,
 	DELETE_FAIL,
+	READFAIL,
+	INVALIDEXTENSION,
+	INVALIDHEADER,
+	CHECKSUMFAIL,
 
 	MC_FST_BLOCKS  = 0x05,
 	MBIT_TO_BLOCKS = 0x10,
@@ -76,6 +82,17 @@ class GCMemcard : NonCopyable
 private:
 	friend class CMemcardManagerDebug;
 	bool m_valid;
+	u32 m_loadResult;
+	// TestChecksums() of the system blocks as they were read, before a torn
+	// directory or BAT is replaced with the good copy
+	u32 m_loadChecksums;
+	// Load went back to the older directory because the newer one didn't
+	// agree with the BAT, see DirAheadOfBat
+	bool m_restoredOlderDir;
+	// system blocks whose TestChecksums() result in m_checksumResults is current
+	mutable u32 m_testedChecksums;
+	mutable u32 m_checksumResults;
+	void SetChecksumResult(u16 block, bool failed) const;
 	u8 mci_offset;
 	std::string m_fileName;
 
@@ -88,6 +105,32 @@ private:
 		u8 block[BLOCK_SIZE];
 	};
 	std::vector<GCMBlock> mc_data_blocks;
+
+	// LOAD_MMAP: the data blocks are a private (copy-on-write) view of the card file
+	// LOAD_LAZY: each data block is read from the card file the first time it is accessed,
+	// from m_compressedFile if it is a .mcz
+	u8 m_loadMode;
+	std::string m_backingFileName;
+	File::MappedFile m_mappedFile;
+	GCMBlock *m_mappedBlocks;
+	mutable File::IOFile m_lazyFile;
+	u8 m_lazyFileOffset;
+	mutable std::vector<GCMBlock*> m_lazyBlocks;
+	mutable GCMemcardCompressed m_compressedFile;
+
+	// blocks (system blocks included) that differ from m_syncedFileName on disk,
+	// indexed by absolute block number
+	std::vector<bool> m_dirtyBlocks;
+	// the file the clean blocks were loaded from or last saved to
+	std::string m_syncedFileName;
+	enum
+	{
+		HDR_BLOCK = 0,
+		DIR_BLOCK,
+		DIR_BACKUP_BLOCK,
+		BAT_BLOCK,
+		BAT_BACKUP_BLOCK,
+	};
 #pragma pack(push,1)
 	struct Header {			//Offset	Size	Description
 		 // Serial in libogc
@@ -161,6 +204,7 @@ private:
 	} dir, dir_backup;
 
 	Directory *CurrentDir, *PreviousDir;
+	struct FreeBlockMap;
 	struct BlockAlloc {
 		u16 Checksum;			//0x0000	2	Additive Checksum
 		u16 Checksum_Inv;		//0x0002	2	Inverse Checksum
@@ -169,8 +213,8 @@ private:
 		u16 LastAllocated;		//0x0008	2	last allocated Block
 		u16 Map[BAT_SIZE];		//0x000a	0x1ff8	Map of allocated Blocks
 		u16 GetNextBlock(u16 Block) const;
-		u16 NextFreeBlock(u16 StartingBlock=MC_FST_BLOCKS) const;
-		bool ClearBlocks(u16 StartingBlock, u16 Length);
+		// also marks the blocks as free in FreeBlocksMap
+		bool ClearBlocks(u16 StartingBlock, u16 Length, FreeBlockMap &FreeBlocksMap);
 	} bat,bat_backup;
 
 	BlockAlloc *CurrentBat, *PreviousBat;
@@ -196,17 +240,124 @@ private:
 	}mci_hdr;
 #pragma pack(pop)
 
-	u32 ImportGciInternal(FILE* gcih, const char *inputFile, const std::string &outputFile);
+	// the free data blocks of CurrentBat, one bit per absolute block number.
+	// blocks outside MC_FST_BLOCKS <= block < maxBlock are never free
+	struct FreeBlockMap {
+		u32 Bits[(MC_FST_BLOCKS + BAT_SIZE) / 32];
+		u16 MaxBlock;
+		void Rebuild(const BlockAlloc &Bat, u16 _MaxBlock);
+		void Allocate(u16 Block) { Bits[Block / 32] &= ~(1u << (Block % 32)); }
+		// ignores blocks that aren't on the card, a broken BAT may link to them
+		void Free(u16 Block) { if (Block >= MC_FST_BLOCKS && Block < MaxBlock) Bits[Block / 32] |= 1u << (Block % 32); }
+		bool IsFree(u16 Block) const { return (Bits[Block / 32] >> (Block % 32)) & 1; }
+		// the first Count free blocks in block order from StartingBlock on,
+		// wrapping around to the first data block once. false if fewer
+		// blocks are free
+		bool FindFreeBlocks(u16 StartingBlock, u32 Count, std::vector<u16> &Blocks) const;
+	private:
+		// first free block at or after Block, without wrapping around.
+		// MC_FST_BLOCKS + BAT_SIZE if there is none
+		u16 Scan(u16 Block) const;
+	} m_freeBlocks;
+
+	// lookups over the files in CurrentDir. SetCurrentDirBatInternal rebuilds it,
+	// ImportFile and RemoveFile keep it up to date
+	struct DirectoryIndex {
+		u8 NumFiles;
+		u8 Files[DIRLEN];	// directory index of each file, in directory order
+		u8 Buckets[64];		// first file whose Gamecode and Filename hash to the bucket, 0xFF if none
+		u8 Next[DIRLEN];	// next file in the same bucket
+		void Rebuild(const Directory &Dir);
+		void Add(const Directory &Dir, u8 Index);
+		void Remove(const Directory &Dir, u8 Index);
+		// directory index of the file with d's Gamecode and Filename, DIRLEN if there is none
+		u8 Find(const Directory &Dir, const DEntry &d) const;
+	private:
+		static u8 Hash(const DEntry &d);
+	} m_dirIndex;
+
+	u32 Load(bool forceCreation, bool sjis, u16 sizeMb, u8 loadMode);
+	// true if the newer directory and the newer BAT don't agree, but the older
+	// directory and the newer BAT do. A save that stopped after writing the
+	// directory leaves that behind, with good checksums on both
+	bool DirAheadOfBat() const;
+	// true if every file of Dir has a block chain of its BlockCount in Bat, no
+	// block is used twice and Bat allocates no other blocks. What doesn't
+	// agree is appended to problems unless it is NULL
+	bool CheckDirBat(const Directory &Dir, const BlockAlloc &Bat, std::vector<std::string> *problems) const;
+	static std::string GciFileName(const DEntry &d);
+	// reads the next system block from mcdFile, or block from m_compressedFile if it is open
+	bool ReadSystemBlock(File::IOFile &mcdFile, u16 block, void *dest);
+	u32 ImportGciInternal(FILE* gcih, const char *inputFile);
+	// reads the DEntry and the save from a .gci/.gcs/.sav, converted to a .gci's
+	u32 ReadGci(File::IOFile &gci, const std::string &inputFile, DEntry &tempDEntry, std::vector<GCMBlock> &saveData);
+	// the header size (GCI, GCS or SAV) from the extension and the length of
+	// the save after the DEntry from the file size
+	static u32 GetGciLayout(File::IOFile &gci, const std::string &fileName, u32 &offset, u32 &length);
+	static bool GetSaveType(const std::string &fileName, u32 &saveType);
+	// checks the .gcs/.sav header and converts the DEntry after it to a .gci's
+	static u32 CheckGciHeader(u32 offset, const u8 *header, DEntry &tempDEntry, u32 length);
+	// the GCS bytes of the header saveType starts with, the unused ones zero
+	static void MakeGciHeader(int saveType, u8 *header);
+	static u32 ConvertSave(const std::string &inputFile, const std::string &outputFile, u32 saveType);
 	static void FormatInternal(GCMC_Header &GCP);
 	void SetCurrentDirBatInternal();
+
+	// block is the absolute block number, MC_FST_BLOCKS <= block < maxBlock
+	const GCMBlock& GetDataBlock(u16 block) const;
+	GCMBlock& GetDataBlockForWrite(u16 block);
+	void LoadDataBlock(u16 block) const;
+	// copies length bytes at offset into the save, following its block chain.
+	// false if the save is shorter or its chain leaves the card
+	bool ReadSaveData(u8 index, u32 offset, u32 length, u8* dest) const;
+	// detaches from the card file (LOAD_MMAP/LOAD_LAZY),
+	// copying all data blocks to mc_data_blocks first
+	void ReleaseBackingFile(bool copyBlocks = true);
+
+	// a changed system block also has its checksums tested again
+	void MarkDirty(u16 block)
+	{
+		m_dirtyBlocks[block] = true;
+		if (block < MC_FST_BLOCKS)
+			m_testedChecksums &= ~(1 << block);
+	}
+	void MarkDirty(const Directory *d) { MarkDirty(d == &dir ? DIR_BLOCK : DIR_BACKUP_BLOCK); }
+	void MarkDirty(const BlockAlloc *b) { MarkDirty(b == &bat ? BAT_BLOCK : BAT_BACKUP_BLOCK); }
+	const void* GetSystemBlock(u16 block) const;
+	// true if a crash while writing the dirty blocks in place leaves a loadable card
+	bool CanSaveInPlace() const;
+	// writes only the dirty blocks, the file must already hold the rest of the card
+	bool SaveDirtyBlocks();
+	bool SaveDirtyBlocks(GCMemcardCompressed &mczFile);
+	// writes the whole card as a .mcz
+	bool SaveCompressed(const std::string &fileName);
+	void WriteDirtyBlocks(File::IOFile &mcdFile, u16 first, u16 last) const;
 public:
+	enum
+	{
+		LOAD_FULL = 0,	// read every data block into memory
+		LOAD_MMAP,		// map the card file, falls back to LOAD_FULL if mapping fails (LOAD_LAZY for a .mcz)
+		LOAD_LAZY,		// keep the card file open and read data blocks on first access
+	};
 
-	GCMemcard(const char* fileName, bool forceCreation=false, bool sjis=false, u16 size=MemCard2043Mb);
+	GCMemcard(const char* fileName, bool forceCreation=false, bool sjis=false, u16 size=MemCard2043Mb, u8 loadMode=LOAD_FULL);
+	~GCMemcard();
 	bool IsValid() const { return m_valid; }
+	// SUCCESS or the reason the card failed to load
+	u32 GetLoadResult() const { return m_loadResult; }
 	bool IsAsciiEncoding() const;
 	u16 GetSize() const { return m_sizeMb; }
 	bool Save();
 	bool SaveAs(const char * destination);
+	// true if the card has changes Save hasn't written yet, which includes
+	// the good copies Load restored a broken directory or BAT from
+	bool IsModified() const;
+	// LOAD_LAZY only: reads the system blocks again after something else
+	// wrote to the card file and forgets the data blocks read so far.
+	// changed gets the directory indices whose DEntry is different now.
+	// Leaves the card as it was if it has unsaved changes, or if the file
+	// is no longer a card of the same size with good checksums
+	u32 ReloadSystemBlocks(std::vector<u8> &changed);
 
 	bool ValidMCIHeader();
 	void SetMCIHeader();
@@ -228,6 +379,18 @@ public:
 	u8 GetNumFiles() const;
 	u8 GetFileIndex(u8 fileNumber) const;
 
+	// what a file list shows about one file, see GetFileList
+	struct FileInfo
+	{
+		u8 index;			// directory index, for the DEntry functions
+		u16 blockCount;		// DEntry_BlockCount
+		u16 firstBlock;		// DEntry_FirstBlock
+		std::string title;	// GetSaveComment1
+		std::string comment;	// GetSaveComment2
+	};
+	// every file in directory order, files[fileNumber].index == GetFileIndex(fileNumber)
+	void GetFileList(std::vector<FileInfo> &files) const;
+
 	// get the free blocks from bat
 	u16 GetFreeBlocks() const;
 
@@ -256,27 +419,87 @@ public:
 	// Copies a DEntry from u8 index to DEntry& data
 	bool GetDEntry(u8 index, DEntry &dest) const;
 
+	// checks the checksums (including the ones fixed by restoring a backup on load,
+	// and a directory that was ahead of the BAT)
+	// and that the directory and BAT agree: every file's block chain is
+	// BlockCount blocks long and inside the card, no block is used twice and
+	// the free block count matches the map. Problems found are appended as text
+	u32 CheckFileSystem(std::vector<std::string> &problems) const;
+
 	// assumes there's enough space in buffer
 	// old determines if function uses old or new method of copying data
 	// some functions only work with old way, some only work with new way
 	// TODO: find a function that works for all calls or split into 2 functions
 	u32 GetSaveData(u8 index, std::vector<GCMBlock> &saveBlocks) const;
+	// like GetSaveData, but the blocks are the card's own instead of copies.
+	// They stay valid until the card is resized, formatted or reloaded
+	u32 GetSaveBlocks(u8 index, std::vector<const GCMBlock*> &saveBlocks) const;
 
 	// adds the file to the directory and copies its contents
 	u32 ImportFile(DEntry& direntry, std::vector<GCMBlock> &saveBlocks);
+	u32 ImportFile(DEntry& direntry, const std::vector<const GCMBlock*> &saveBlocks);
 
 	// delete a file from the directory
 	u32 RemoveFile(u8 index);
 
+	// moves the files into one run of blocks each, one after the other from
+	// the first data block, keeping their order on the card. Blocks that are
+	// already where they belong stay put, movedBlocks is the number that didn't
+	// and movedFiles the number of files they belong to. Files without blocks
+	// aren't moved, they're left pointing at no block. Both directories and
+	// BATs get the new layout, so Save writes a new file instead of updating
+	// the card in place
+	u32 Defragment(u16 &movedBlocks, u8 &movedFiles);
+
 	// reads a save from another memcard, and imports the data into this memcard
 	u32 CopyFrom(const GCMemcard& source, u8 index);
 
-	// reads a .gci/.gcs/.sav file and calls ImportFile or saves out a gci file
+	// reads a .gci/.gcs/.sav file and calls ImportFile, or converts it to a
+	// .gci if outputFile is given (GCS instead of SUCCESS if that worked)
 	u32 ImportGci(const char* inputFile,const std::string &outputFile);
+	// converts a .gci/.gcs/.sav to the format of outputFile's extension. Only
+	// the header and DEntry change, the save is copied through a small buffer
+	// instead of being read whole. outputFile is only replaced once the
+	// conversion is complete, and can't be inputFile
+	static u32 ConvertSave(const std::string &inputFile, const std::string &outputFile);
+	// converts every .gci/.gcs/.sav in inputDirectory into outputDirectory with
+	// extension (".gci", ".gcs" or ".sav"). fileNames gets the files found,
+	// results the result of each. A file that would be converted onto itself
+	// is left alone. Returns SUCCESS or the first error
+	static u32 ConvertSaves(const std::string &inputDirectory, const std::string &outputDirectory,
+		const std::string &extension, std::vector<std::string> &fileNames, std::vector<u32> &results);
+
+	// imports the .gci/.gcs/.sav files with a single directory and BAT
+	// update, all of them or none. Every file is read and checked first,
+	// results gets what is wrong with each one (SUCCESS if nothing is). The
+	// card only changes if nothing is and all of them fit, and the files end
+	// up where calling ImportGci for each of them in order would put them.
+	// Returns SUCCESS, the first file's error, OUTOFDIRENTRIES or OUTOFBLOCKS
+	u32 ImportBatch(const std::vector<std::string> &inputFiles, std::vector<u32> &results);
 
 	// writes a .gci file to disk containing index
 	u32 ExportGci(u8 index, const char* fileName, const std::string &directory) const;
 
+	// what ExportAll did with every save
+	struct ExportReport
+	{
+		struct Save
+		{
+			u8 index;				// directory index
+			std::string fileName;	// GCI_FileName
+			u32 result;				// SUCCESS or why it wasn't exported
+		};
+		std::vector<Save> saves;	// in directory order
+		u32 numExported;
+		u32 elapsedMs;
+	};
+	// exports every save as .gci into directory, written by numThreads
+	// threads (0 picks a few), or into the single tar file directory names
+	// if it ends in .tar. The directory is read once, before any file is
+	// written, nothing may change the card until ExportAll returns.
+	// Returns SUCCESS or the first error, report has every save's result
+	u32 ExportAll(const std::string &directory, ExportReport &report, u32 numThreads = 0) const;
+
 	// GCI files are untouched, SAV files are byteswapped
 	// GCS files have the block count set, default is 1 (For export as GCS)
 	static void Gcs_SavConvert(DEntry &tempDEntry, int saveType, u32 length = BLOCK_SIZE);
@@ -287,10 +510,31 @@ public:
 	// reads the animation frames
 	u32 ReadAnimRGBA8(u8 index, u32* buffer, u8 *delays) const;
 
+	// hash of the DEntry and of the part of the save the banner and the
+	// animation are read from, 0 if the save can't be read
+	u64 GetImageHash(u8 index) const;
+
 	void CARD_GetFlashID(u8 *flashid1, u8 *flashid2, u8 *flashid3);
 	void CARD_GetSerialNo(u32 *serial1,u32 *serial2);
-	s32 FZEROGX_MakeSaveGameValid(DEntry& direntry, std::vector<GCMBlock> &FileBuffer);
-	s32 PSO_MakeSaveGameValid(DEntry& direntry, std::vector<GCMBlock> &FileBuffer);
+	s32 FZEROGX_MakeSaveGameValid(DEntry& direntry, const std::vector<GCMBlock*> &FileBuffer);
+	s32 PSO_MakeSaveGameValid(DEntry& direntry, const std::vector<GCMBlock*> &FileBuffer);
+
+private:
+	// the DEntry, converted for saveType, and the blocks of a save as the
+	// buffers of a .gci/.gcs/.sav after its header. dentry has to outlive them
+	u32 GetExportBuffers(u8 index, int saveType, DEntry &dentry, std::vector<File::IOFile::Buffer> &buffers) const;
+	// ExportAll into a tar file, saves has the buffers of every .gci
+	u32 ExportTar(const std::string &fileName, ExportReport &report,
+		const std::vector<std::vector<File::IOFile::Buffer> > &saves) const;
+	// adds the file to UpdatedDir and UpdatedBat, copies of the current ones,
+	// and copies its blocks to blocks, free blocks from FindFreeBlocks. The
+	// caller has checked that the file fits. m_dirIndex and m_freeBlocks
+	// already describe the copies afterwards
+	void AddFile(Directory &UpdatedDir, BlockAlloc &UpdatedBat, DEntry& direntry,
+		const std::vector<const GCMBlock*> &saveBlocks, const u16 *blocks);
+	// makes UpdatedDir and UpdatedBat the current directory and BAT, one
+	// update counter step after the ones they replace
+	void CommitDirBat(Directory &UpdatedDir, BlockAlloc &UpdatedBat);
 };
 #endif
 
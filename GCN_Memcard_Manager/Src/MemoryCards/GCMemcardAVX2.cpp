@@ -0,0 +1,61 @@
+// Copyright (C) 2003 Dolphin Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official SVN repository and contact information can be found at
+// http://code.google.com/p/dolphin-emu/
+
+// AVX2 version of the system block checksum sum, GCMemcard.cpp picks it
+// when cpu_info.bAVX2 is set. Like ColorUtilAVX2.cpp it doesn't include
+// Common.h, immintrin.h clashes with the pshufb from CommonFuncs.h.
+
+#include "CommonTypes.h"
+
+// keep in sync with GCMemcard.cpp
+#if (defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)) && \
+	((defined(_MSC_VER) && _MSC_VER >= 1700) || defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+// SumBE16_SSE2 (GCMemcard.cpp) on 16 values at a time
+TARGET_AVX2 u16 SumBE16_AVX2(const u16 *buf, u32 length)
+{
+	const __m256i shuffle = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+		1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+
+	__m256i acc = _mm256_setzero_si256();
+	u32 i = 0;
+	for (; i + 16 <= length; i += 16)
+	{
+		__m256i val = _mm256_loadu_si256((const __m256i*)(buf + i));
+		acc = _mm256_add_epi16(acc, _mm256_shuffle_epi8(val, shuffle));
+	}
+
+	__m128i sum = _mm_add_epi16(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+	sum = _mm_add_epi16(sum, _mm_srli_si128(sum, 8));
+	sum = _mm_add_epi16(sum, _mm_srli_si128(sum, 4));
+	sum = _mm_add_epi16(sum, _mm_srli_si128(sum, 2));
+	u16 result = (u16)_mm_cvtsi128_si32(sum);
+
+	for (; i < length; ++i)
+		result += (u16)((buf[i] << 8) | (buf[i] >> 8));
+	return result;
+}
+
+#endif
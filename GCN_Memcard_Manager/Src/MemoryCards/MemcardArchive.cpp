@@ -0,0 +1,308 @@
+// Copyright (C) 2003 Dolphin Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official SVN repository and contact information can be found at
+// http://code.google.com/p/dolphin-emu/
+
+#include "MemcardArchive.h"
+#include "GCMemcard.h"
+#include "MemcardCompressed.h"
+#include "StringUtil.h"
+#include "Crypto/sha1.h"
+
+// "GCMA"
+static const u32 MANIFEST_MAGIC = 0x414d4347;
+static const u32 MANIFEST_VERSION = 1;
+
+// a card name is a file in cards/, it can't lead anywhere else
+static bool IsValidCardName(const std::string &name)
+{
+	return !name.empty() && name != "." && name != ".." &&
+		name.find_first_of("/\\:") == std::string::npos;
+}
+
+// a file next to fileName that doesn't exist yet, nor does its ".tmp" file,
+// with the given extension so GCMemcard still sees the right format
+static std::string UnusedFileName(const std::string &fileName, const std::string &extension)
+{
+	std::string path, name;
+	SplitPath(fileName, &path, &name, NULL);
+	for (u32 i = 0; ; ++i)
+	{
+		const std::string unusedName = StringFromFormat("%s%s.%u.tmp%s", path.c_str(), name.c_str(), i, extension.c_str());
+		if (!File::Exists(unusedName) && !File::Exists(unusedName + ".tmp"))
+			return unusedName;
+	}
+}
+
+GCMemcardArchive::GCMemcardArchive(const std::string &directory)
+	: m_open(false)
+	, m_directory(directory + DIR_SEP)
+{
+	File::CreateFullPath(m_directory + "cards" DIR_SEP);
+
+	const std::string dataName = m_directory + "blocks.dat";
+	const std::string hashName = m_directory + "blocks.idx";
+	if (!File::Exists(dataName))
+		File::CreateEmptyFile(dataName);
+	if (!File::Exists(hashName))
+		File::CreateEmptyFile(hashName);
+	m_blockData.Open(dataName, "r+b");
+	m_blockHashes.Open(hashName, "r+b");
+	if (!m_blockData.IsOpen() || !m_blockHashes.IsOpen())
+		return;
+
+	// an interrupted AddCard may have left a block without its hash
+	// (or the other way around), neither is used by a manifest
+	u32 numBlocks = (u32)std::min(m_blockData.GetSize() / BLOCK_SIZE, m_blockHashes.GetSize() / sizeof(BlockHash));
+	std::vector<BlockHash> hashes(numBlocks);
+	if (numBlocks && !m_blockHashes.ReadArray(&hashes[0], numBlocks))
+		return;
+	for (u32 i = 0; i < numBlocks; ++i)
+		m_blockIndex.insert(std::make_pair(hashes[i], i));
+
+	m_open = m_blockData.Resize((u64)numBlocks * BLOCK_SIZE) &&
+		m_blockHashes.Resize((u64)numBlocks * sizeof(BlockHash));
+}
+
+u32 GCMemcardArchive::AddCard(const std::string &fileName, const std::string &name, u32 &newBlocks)
+{
+	newBlocks = 0;
+	// GCMemcard would offer to create a missing card
+	if (!m_open || !IsValidCardName(name) || !File::Exists(fileName))
+		return OPENFAIL;
+
+	// only cards are stored, everything after this reads the file as it is
+	u16 numBlocks;
+	{
+		GCMemcard card(fileName.c_str(), false, false, MemCard2043Mb, GCMemcard::LOAD_LAZY);
+		if (!card.IsValid())
+			return card.GetLoadResult();
+		numBlocks = card.GetSize() * MBIT_TO_BLOCKS;
+	}
+
+	// a .mcz is stored as the card in it
+	File::IOFile cardFile;
+	GCMemcardCompressed mczFile;
+	std::vector<u8> mciHeader;
+	if (GCMemcardCompressed::IsCompressedName(fileName))
+	{
+		if (!mczFile.Open(fileName))
+			return READFAIL;
+	}
+	else
+	{
+		cardFile.Open(fileName, "rb");
+		u64 size = cardFile.GetSize();
+		if (size < (u64)numBlocks * BLOCK_SIZE)
+			return INVALIDFILESIZE;
+		mciHeader.resize((size_t)(size - (u64)numBlocks * BLOCK_SIZE));
+		if (!mciHeader.empty() && !cardFile.ReadBytes(&mciHeader[0], mciHeader.size()))
+			return READFAIL;
+	}
+
+	u32 firstNewBlock = GetNumBlocks();
+	std::vector<u32> blocks(numBlocks);
+	std::vector<BlockHash> newHashes;
+	u8 block[BLOCK_SIZE];
+	m_blockData.Seek(0, SEEK_END);
+	for (u16 i = 0; i < numBlocks; ++i)
+	{
+		if (!(mczFile.IsOpen() ? mczFile.ReadBlock(i, block) : cardFile.ReadBytes(block, BLOCK_SIZE)))
+		{
+			DropBlocks(firstNewBlock, newHashes);
+			return READFAIL;
+		}
+
+		BlockHash hash;
+		sha1(block, BLOCK_SIZE, hash.hash);
+		std::map<BlockHash, u32>::const_iterator it = m_blockIndex.find(hash);
+		if (it != m_blockIndex.end())
+		{
+			blocks[i] = it->second;
+			continue;
+		}
+
+		if (!m_blockData.WriteBytes(block, BLOCK_SIZE))
+		{
+			DropBlocks(firstNewBlock, newHashes);
+			return WRITEFAIL;
+		}
+		blocks[i] = firstNewBlock + (u32)newHashes.size();
+		m_blockIndex.insert(std::make_pair(hash, blocks[i]));
+		newHashes.push_back(hash);
+	}
+
+	// the blocks have to be on disk before the hashes that say they're
+	// there, and both before the manifest
+	if (!newHashes.empty())
+	{
+		m_blockHashes.Seek(0, SEEK_END);
+		if (!m_blockData.Sync() || !m_blockHashes.WriteArray(&newHashes[0], newHashes.size()) ||
+			!m_blockHashes.Sync())
+		{
+			DropBlocks(firstNewBlock, newHashes);
+			return WRITEFAIL;
+		}
+	}
+	newBlocks = (u32)newHashes.size();
+
+	const std::string tempName = m_directory + "manifest.tmp";
+	File::IOFile manifest(tempName, "wb");
+	ManifestHeader header;
+	header.magic = MANIFEST_MAGIC;
+	header.version = MANIFEST_VERSION;
+	header.mciHeaderSize = (u32)mciHeader.size();
+	header.numBlocks = numBlocks;
+	bool written = manifest.WriteArray(&header, 1) &&
+		(mciHeader.empty() || manifest.WriteBytes(&mciHeader[0], mciHeader.size())) &&
+		manifest.WriteArray(&blocks[0], blocks.size()) &&
+		manifest.Sync();
+	if (!manifest.Close() || !written || !File::Rename(tempName, GetManifestName(name)))
+	{
+		File::Delete(tempName);
+		return WRITEFAIL;
+	}
+	return SUCCESS;
+}
+
+u32 GCMemcardArchive::ExtractCard(const std::string &name, const std::string &fileName)
+{
+	if (!m_open || !IsValidCardName(name))
+		return OPENFAIL;
+
+	std::vector<u8> mciHeader;
+	std::vector<u32> blocks;
+	if (!ReadManifest(name, mciHeader, blocks))
+		return READFAIL;
+
+	std::string extension;
+	SplitPath(fileName, NULL, NULL, &extension);
+	bool mci = !strcasecmp(extension.c_str(), ".mci");
+	if (mci == !mciHeader.empty() && !GCMemcardCompressed::IsCompressedName(fileName))
+		return WriteImage(mciHeader, blocks, fileName);
+
+	// the mci header is added or dropped, or the card compressed, by
+	// GCMemcard, from an image with the extension the card was added with.
+	// The card is saved next to fileName and only replaces it when complete
+	const std::string imageName = UnusedFileName(fileName, mciHeader.empty() ? ".raw" : ".mci");
+	u32 result = WriteImage(mciHeader, blocks, imageName);
+	if (result == SUCCESS)
+	{
+		GCMemcard card(imageName.c_str());
+		if (!card.IsValid())
+			result = card.GetLoadResult();
+		else
+		{
+			const std::string savedName = UnusedFileName(fileName, extension);
+			if (!card.SaveAs(savedName.c_str()) || !File::Rename(savedName, fileName))
+			{
+				File::Delete(savedName);
+				result = WRITEFAIL;
+			}
+		}
+	}
+	File::Delete(imageName);
+	return result;
+}
+
+bool GCMemcardArchive::RemoveCard(const std::string &name)
+{
+	// the blocks stay, other cards may use them
+	return m_open && IsValidCardName(name) && File::Delete(GetManifestName(name));
+}
+
+void GCMemcardArchive::GetCardNames(std::vector<std::string> &names) const
+{
+	names.clear();
+	File::FSTEntry entry;
+	File::ScanDirectoryTree(m_directory + "cards", entry);
+	for (u32 i = 0; i < entry.children.size(); ++i)
+		if (!entry.children[i].isDirectory)
+			names.push_back(entry.children[i].virtualName);
+}
+
+void GCMemcardArchive::DropBlocks(u32 firstBlock, const std::vector<BlockHash> &hashes)
+{
+	// nothing refers to them yet, block numbers have to stay the same in
+	// both files
+	for (u32 i = 0; i < hashes.size(); ++i)
+		m_blockIndex.erase(hashes[i]);
+	m_blockData.Clear();
+	m_blockHashes.Clear();
+	m_open = m_blockData.Resize((u64)firstBlock * BLOCK_SIZE) &&
+		m_blockHashes.Resize((u64)firstBlock * sizeof(BlockHash));
+}
+
+std::string GCMemcardArchive::GetManifestName(const std::string &name) const
+{
+	return m_directory + "cards" DIR_SEP + name;
+}
+
+bool GCMemcardArchive::ReadManifest(const std::string &name, std::vector<u8> &mciHeader, std::vector<u32> &blocks) const
+{
+	File::IOFile manifest(GetManifestName(name), "rb");
+	ManifestHeader header;
+	if (!manifest.ReadArray(&header, 1) || header.magic != MANIFEST_MAGIC ||
+		header.version != MANIFEST_VERSION || header.mciHeaderSize > BLOCK_SIZE ||
+		header.numBlocks > MemCard2043Mb * MBIT_TO_BLOCKS)
+	{
+		return false;
+	}
+
+	mciHeader.resize(header.mciHeaderSize);
+	blocks.resize(header.numBlocks);
+	if ((!mciHeader.empty() && !manifest.ReadBytes(&mciHeader[0], mciHeader.size())) ||
+		(!blocks.empty() && !manifest.ReadArray(&blocks[0], blocks.size())))
+	{
+		return false;
+	}
+	for (u32 i = 0; i < blocks.size(); ++i)
+		if (blocks[i] >= GetNumBlocks())
+			return false;
+	return true;
+}
+
+u32 GCMemcardArchive::WriteImage(const std::vector<u8> &mciHeader, const std::vector<u32> &blocks, const std::string &fileName)
+{
+	// written next to the card and renamed over it when complete, like GCMemcard::Save
+	const std::string tempName = fileName + ".tmp";
+	File::IOFile cardFile(tempName, "wb");
+	if (!mciHeader.empty())
+		cardFile.WriteBytes(&mciHeader[0], mciHeader.size());
+
+	u8 block[BLOCK_SIZE];
+	for (u32 i = 0; i < blocks.size(); ++i)
+	{
+		// cards are mostly made of runs of consecutive blocks
+		if ((i == 0 || blocks[i] != blocks[i - 1] + 1) && !m_blockData.Seek((s64)blocks[i] * BLOCK_SIZE, SEEK_SET))
+			break;
+		if (!m_blockData.ReadBytes(block, BLOCK_SIZE) || !cardFile.WriteBytes(block, BLOCK_SIZE))
+			break;
+	}
+
+	if (!m_blockData.IsGood())
+	{
+		m_blockData.Clear();
+		cardFile.Close();
+		File::Delete(tempName);
+		return m_blockData.IsOpen() ? READFAIL : OPENFAIL;
+	}
+	if (!cardFile.Close() || !File::Rename(tempName, fileName))
+	{
+		File::Delete(tempName);
+		return WRITEFAIL;
+	}
+	return SUCCESS;
+}
@@ -0,0 +1,92 @@
+// Copyright (C) 2003 Dolphin Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official SVN repository and contact information can be found at
+// http://code.google.com/p/dolphin-emu/
+
+#ifndef __MEMCARDARCHIVE_h__
+#define __MEMCARDARCHIVE_h__
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Common.h"
+#include "FileUtil.h"
+
+// Stores many memory card images in a directory, keeping every distinct
+// 8 KiB block only once. A save copied between cards is made of the same
+// blocks on each of them, and so are the empty blocks, so most of an
+// archive of similar cards is references.
+//
+// The directory holds
+//   blocks.dat	the distinct blocks, appended as they are first seen
+//   blocks.idx	the SHA-1 of each block in blocks.dat, in the same order
+//   cards/		one manifest per card: the mci header, if there is one,
+//				and the number in blocks.dat of every block of the image
+// Blocks are on disk before the manifest that refers to them, and a
+// manifest is only renamed into place once it's complete, so an
+// interrupted AddCard leaves at most some unused blocks behind.
+class GCMemcardArchive : NonCopyable
+{
+public:
+	// opens the archive in directory, creating it if it doesn't exist
+	GCMemcardArchive(const std::string &directory);
+
+	bool IsOpen() const { return m_open; }
+
+	// stores the card in fileName as name, replacing a card stored under
+	// the same name. name is a file name without a path, and can't be "..".
+	// newBlocks is the number of blocks that weren't in the archive before.
+	// A .mcz is stored as the card it holds
+	u32 AddCard(const std::string &fileName, const std::string &name, u32 &newBlocks);
+	// writes the card stored as name to fileName. The image is the one that
+	// was added byte for byte, unless one of the two is a .mci and the
+	// other isn't, or fileName is a .mcz
+	u32 ExtractCard(const std::string &name, const std::string &fileName);
+	bool RemoveCard(const std::string &name);
+
+	void GetCardNames(std::vector<std::string> &names) const;
+	u32 GetNumBlocks() const { return (u32)m_blockIndex.size(); }
+
+private:
+	struct BlockHash
+	{
+		u8 hash[20];
+		bool operator<(const BlockHash &other) const { return memcmp(hash, other.hash, sizeof(hash)) < 0; }
+	};
+
+	struct ManifestHeader
+	{
+		u32 magic;
+		u32 version;
+		u32 mciHeaderSize;	// 0 for .raw/.gcp/.mcz
+		u32 numBlocks;		// system blocks included
+	};
+
+	// forgets the blocks from firstBlock on, after AddCard failed
+	void DropBlocks(u32 firstBlock, const std::vector<BlockHash> &hashes);
+	std::string GetManifestName(const std::string &name) const;
+	bool ReadManifest(const std::string &name, std::vector<u8> &mciHeader, std::vector<u32> &blocks) const;
+	u32 WriteImage(const std::vector<u8> &mciHeader, const std::vector<u32> &blocks, const std::string &fileName);
+
+	bool m_open;
+	std::string m_directory;
+	File::IOFile m_blockData;
+	File::IOFile m_blockHashes;
+	// number in blocks.dat of every block that is in the archive
+	std::map<BlockHash, u32> m_blockIndex;
+};
+
+#endif
@@ -0,0 +1,207 @@
+// Copyright (C) 2003 Dolphin Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official SVN repository and contact information can be found at
+// http://code.google.com/p/dolphin-emu/
+
+#include <algorithm>
+#include <set>
+
+#include "MemcardBatch.h"
+#include "GCMemcard.h"
+#include "FileSearch.h"
+#include "FileUtil.h"
+#include "StringUtil.h"
+#include "Timer.h"
+
+GCMemcardBatch::GCMemcardBatch(u8 operation, const std::string &exportDirectory)
+	: m_operation(operation)
+	, m_exportDirectory(exportDirectory)
+	, m_elapsedMs(0)
+	, m_nextCard(0)
+{
+}
+
+void GCMemcardBatch::AddCard(const std::string &fileName)
+{
+	CardResult card;
+	card.fileName = fileName;
+	card.result = NOMEMCARD;
+	card.numFiles = 0;
+	card.numExported = 0;
+	card.repaired = false;
+	m_results.push_back(card);
+}
+
+u32 GCMemcardBatch::AddDirectory(const std::string &directory)
+{
+	CFileSearch::XStringVector extensions, directories;
+	extensions.push_back("*.raw");
+	extensions.push_back("*.gcp");
+	extensions.push_back("*.mci");
+	extensions.push_back("*.mcz");
+	directories.push_back(directory);
+
+	CFileSearch search(extensions, directories);
+	const CFileSearch::XStringVector &fileNames = search.GetFileNames();
+	for (u32 i = 0; i < fileNames.size(); ++i)
+		AddCard(fileNames[i]);
+	return (u32)fileNames.size();
+}
+
+void GCMemcardBatch::Run(u32 numThreads)
+{
+	if (m_operation == BATCH_EXPORT)
+	{
+		// every card exports into a directory named after it, cards with
+		// the same name from different directories get a number appended
+		File::CreateFullPath(m_exportDirectory + DIR_SEP);
+		std::set<std::string> names;
+		for (u32 i = 0; i < m_results.size(); ++i)
+		{
+			std::string name, extension;
+			SplitPath(m_results[i].fileName, NULL, &name, &extension);
+			name += extension;
+			std::string unique = name;
+			for (int n = 2; !names.insert(unique).second; ++n)
+				unique = StringFromFormat("%s_%d", name.c_str(), n);
+			m_results[i].exportDirectory = m_exportDirectory + DIR_SEP + unique;
+		}
+	}
+
+	if (numThreads == 0)
+		numThreads = std::thread::hardware_concurrency();
+	if (numThreads == 0)
+		numThreads = 1;
+	if (numThreads > m_results.size())
+		numThreads = (u32)m_results.size();
+
+	u32 startTime = Common::Timer::GetTimeMs();
+
+	m_nextCard = 0;
+	std::vector<std::thread*> threads;
+	for (u32 i = 0; i < numThreads; ++i)
+		threads.push_back(new std::thread(&GCMemcardBatch::WorkerThread, this));
+	for (u32 i = 0; i < threads.size(); ++i)
+	{
+		threads[i]->join();
+		delete threads[i];
+	}
+
+	m_elapsedMs = Common::Timer::GetTimeMs() - startTime;
+}
+
+u32 GCMemcardBatch::GetNumFailed() const
+{
+	u32 failed = 0;
+	for (u32 i = 0; i < m_results.size(); ++i)
+		if (m_results[i].result != SUCCESS)
+			++failed;
+	return failed;
+}
+
+u32 GCMemcardBatch::GetNumRepaired() const
+{
+	u32 repaired = 0;
+	for (u32 i = 0; i < m_results.size(); ++i)
+		if (m_results[i].repaired)
+			++repaired;
+	return repaired;
+}
+
+float GCMemcardBatch::GetCardsPerSecond() const
+{
+	// anything faster than the timer resolution counts as one millisecond
+	return m_results.size() * 1000.0f / std::max<u32>(m_elapsedMs, 1);
+}
+
+void GCMemcardBatch::WorkerThread(GCMemcardBatch *batch)
+{
+	Common::SetCurrentThreadName("Memcard batch");
+
+	while (true)
+	{
+		u32 index;
+		{
+			std::lock_guard<std::mutex> lk(batch->m_lock);
+			if (batch->m_nextCard >= batch->m_results.size())
+				return;
+			index = batch->m_nextCard++;
+		}
+		// each worker only writes the result of the card it took. The
+		// alerts of a card end up with its problems instead of the handler
+		CardResult &card = batch->m_results[index];
+		SetThreadAlertLog(&card.problems);
+		batch->ProcessCard(card);
+		SetThreadAlertLog(NULL);
+	}
+}
+
+void GCMemcardBatch::ProcessCard(CardResult &card) const
+{
+	// only the blocks an operation actually touches are read from the file
+	GCMemcard memcard(card.fileName.c_str(), false, false, MemCard2043Mb, GCMemcard::LOAD_LAZY);
+	if (!memcard.IsValid())
+	{
+		card.result = memcard.GetLoadResult();
+		return;
+	}
+
+	card.numFiles = memcard.GetNumFiles();
+	card.result = SUCCESS;
+
+	switch (m_operation)
+	{
+	case BATCH_VALIDATE:
+		card.result = memcard.CheckFileSystem(card.problems);
+		break;
+
+	case BATCH_FIXCHECKSUMS:
+	{
+		// loading already replaced a broken directory or BAT with the good
+		// copy, only those cards have anything to write back
+		card.result = memcard.CheckFileSystem(card.problems);
+		if (!memcard.IsModified())
+			break;
+		memcard.FixChecksums();
+		if (!memcard.Save())
+		{
+			card.result = WRITEFAIL;
+			break;
+		}
+
+		// the restored copies are still reported, the card as saved tells
+		// whether anything else is wrong
+		card.repaired = true;
+		GCMemcard saved(card.fileName.c_str(), false, false, MemCard2043Mb, GCMemcard::LOAD_LAZY);
+		std::vector<std::string> remaining;
+		card.result = saved.IsValid() ? saved.CheckFileSystem(remaining) : saved.GetLoadResult();
+		break;
+	}
+
+	case BATCH_EXPORT:
+	{
+		// the cards are already spread over the workers, one writer each
+		GCMemcard::ExportReport report;
+		card.result = memcard.ExportAll(card.exportDirectory, report, 1);
+		card.numExported = (u8)report.numExported;
+		for (u32 i = 0; i < report.saves.size(); ++i)
+		{
+			if (report.saves[i].result != SUCCESS)
+				card.problems.push_back(StringFromFormat("%s: export failed", report.saves[i].fileName.c_str()));
+		}
+		break;
+	}
+	}
+}
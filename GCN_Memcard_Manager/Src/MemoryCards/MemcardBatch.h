@@ -0,0 +1,85 @@
+// Copyright (C) 2003 Dolphin Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official SVN repository and contact information can be found at
+// http://code.google.com/p/dolphin-emu/
+
+#ifndef __MEMCARDBATCH_h__
+#define __MEMCARDBATCH_h__
+
+#include <string>
+#include <vector>
+
+#include "Common.h"
+#include "Thread.h"
+
+// Runs one operation over a list of memory card images on a pool of
+// worker threads. Every card is handled by a single thread with its own
+// GCMemcard, so the cards never share any state.
+class GCMemcardBatch : NonCopyable
+{
+public:
+	enum
+	{
+		BATCH_LOAD = 0,		// only load the cards
+		BATCH_VALIDATE,		// load and check the file system
+		BATCH_FIXCHECKSUMS,	// check the file system, save the cards Load repaired
+		BATCH_EXPORT,		// export every save as .gci into <export directory>/<card name>
+	};
+
+	struct CardResult
+	{
+		std::string fileName;
+		std::string exportDirectory;
+		u32 result;		// SUCCESS or the first error
+		u8 numFiles;
+		u8 numExported;
+		// BATCH_FIXCHECKSUMS: the repaired card was saved, result is what is
+		// still wrong with it
+		bool repaired;
+		// what the operation found, and the alerts raised while loading or saving the card
+		std::vector<std::string> problems;
+	};
+
+	GCMemcardBatch(u8 operation, const std::string &exportDirectory = "");
+
+	void AddCard(const std::string &fileName);
+	// adds the .raw/.gcp/.mci/.mcz files in directory (not its subdirectories),
+	// returns how many were found
+	u32 AddDirectory(const std::string &directory);
+
+	// processes every card that was added, numThreads 0 uses one thread per CPU
+	void Run(u32 numThreads = 0);
+
+	const std::vector<CardResult>& GetResults() const { return m_results; }
+	u32 GetNumFailed() const;
+	u32 GetNumRepaired() const;
+	u32 GetElapsedMs() const { return m_elapsedMs; }
+	float GetCardsPerSecond() const;
+
+private:
+	static void WorkerThread(GCMemcardBatch *batch);
+	void ProcessCard(CardResult &card) const;
+
+	u8 m_operation;
+	std::string m_exportDirectory;
+	std::vector<CardResult> m_results;
+	u32 m_elapsedMs;
+
+	// index of the next card a worker takes
+	std::mutex m_lock;
+	u32 m_nextCard;
+};
+
+#endif
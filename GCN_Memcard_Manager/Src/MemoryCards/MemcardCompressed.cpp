@@ -0,0 +1,209 @@
+// Copyright (C) 2003 Dolphin Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official SVN repository and contact information can be found at
+// http://code.google.com/p/dolphin-emu/
+
+#include <zlib.h>
+
+#include "MemcardCompressed.h"
+#include "GCMemcard.h"
+#include "StringUtil.h"
+
+// "GCMZ"
+static const u32 MCZ_MAGIC = 0x5a4d4347;
+static const u32 MCZ_VERSION = 1;
+
+static bool IsErased(const u8 *block)
+{
+	for (u32 i = 0; i < BLOCK_SIZE; ++i)
+		if (block[i] != 0xFF)
+			return false;
+	return true;
+}
+
+GCMemcardCompressed::GCMemcardCompressed()
+	: m_fileSize(0)
+	, m_usedSize(0)
+{
+}
+
+bool GCMemcardCompressed::IsCompressedName(const std::string &fileName)
+{
+	std::string extension;
+	SplitPath(fileName, NULL, NULL, &extension);
+	return !strcasecmp(extension.c_str(), ".mcz");
+}
+
+bool GCMemcardCompressed::Open(const std::string &fileName, bool forWrite)
+{
+	Close();
+	if (!m_file.Open(fileName, forWrite ? "r+b" : "rb"))
+		return false;
+
+	Header header;
+	m_fileSize = m_file.GetSize();
+	if (!m_file.ReadArray(&header, 1) || header.magic != MCZ_MAGIC || header.version != MCZ_VERSION ||
+		header.numBlocks < MC_FST_BLOCKS || header.numBlocks > MemCard2043Mb * MBIT_TO_BLOCKS)
+	{
+		Close();
+		return false;
+	}
+
+	m_index.resize(header.numBlocks);
+	m_changed.assign(header.numBlocks, false);
+	if (!m_file.ReadArray(&m_index[0], m_index.size()))
+	{
+		Close();
+		return false;
+	}
+	for (u32 i = 0; i < m_index.size(); ++i)
+	{
+		const IndexEntry &entry = m_index[i];
+		if (entry.size > BLOCK_SIZE ||
+			(entry.size && (entry.offset < GetDataStart() || (u64)entry.offset + entry.size > m_fileSize)))
+		{
+			Close();
+			return false;
+		}
+		m_usedSize += entry.size;
+	}
+	return true;
+}
+
+bool GCMemcardCompressed::Create(const std::string &fileName, u16 numBlocks)
+{
+	Close();
+	if (!m_file.Open(fileName, "w+b"))
+		return false;
+
+	IndexEntry erased;
+	erased.offset = 0;
+	erased.size = 0;
+	m_index.assign(numBlocks, erased);
+	m_changed.assign(numBlocks, true);
+	m_fileSize = GetDataStart();
+
+	Header header;
+	header.magic = MCZ_MAGIC;
+	header.version = MCZ_VERSION;
+	header.numBlocks = numBlocks;
+	header.pad = 0;
+	return m_file.WriteArray(&header, 1);
+}
+
+bool GCMemcardCompressed::Close()
+{
+	m_index.clear();
+	m_changed.clear();
+	m_fileSize = m_usedSize = 0;
+	return m_file.Close();
+}
+
+bool GCMemcardCompressed::IsFragmented() const
+{
+	return m_fileSize - GetDataStart() - m_usedSize > m_usedSize;
+}
+
+bool GCMemcardCompressed::ReadBlock(u16 block, u8 *dest)
+{
+	if (block >= m_index.size())
+		return false;
+
+	const IndexEntry &entry = m_index[block];
+	if (entry.size == 0)
+	{
+		memset(dest, 0xFF, BLOCK_SIZE);
+		return true;
+	}
+
+	bool read;
+	if (entry.size == BLOCK_SIZE)
+	{
+		read = m_file.Seek(entry.offset, SEEK_SET) && m_file.ReadBytes(dest, BLOCK_SIZE);
+	}
+	else
+	{
+		m_buffer.resize(entry.size);
+		uLongf size = BLOCK_SIZE;
+		read = m_file.Seek(entry.offset, SEEK_SET) && m_file.ReadBytes(&m_buffer[0], entry.size) &&
+			uncompress(dest, &size, &m_buffer[0], entry.size) == Z_OK && size == BLOCK_SIZE;
+	}
+	if (!read)
+		m_file.Clear();
+	return read;
+}
+
+bool GCMemcardCompressed::WriteBlock(u16 block, const u8 *src)
+{
+	if (block >= m_index.size())
+		return false;
+
+	IndexEntry entry;
+	entry.offset = 0;
+	entry.size = 0;
+	if (!IsErased(src))
+	{
+		uLongf size = compressBound(BLOCK_SIZE);
+		m_buffer.resize(size);
+		const u8 *data = &m_buffer[0];
+		if (compress2(&m_buffer[0], &size, src, BLOCK_SIZE, Z_DEFAULT_COMPRESSION) != Z_OK || size >= BLOCK_SIZE)
+		{
+			data = src;
+			size = BLOCK_SIZE;
+		}
+
+		// offsets are 32 bit, Save rewrites a fragmented file long before that
+		if (m_fileSize + size > 0xFFFFFFFF ||
+			!m_file.Seek(m_fileSize, SEEK_SET) || !m_file.WriteBytes(data, size))
+		{
+			return false;
+		}
+		entry.offset = (u32)m_fileSize;
+		entry.size = (u32)size;
+		m_fileSize += size;
+	}
+
+	m_usedSize = m_usedSize - m_index[block].size + entry.size;
+	m_index[block] = entry;
+	m_changed[block] = true;
+	return true;
+}
+
+bool GCMemcardCompressed::Commit()
+{
+	if (!m_file.Sync())
+		return false;
+
+	// runs of changed entries are written with a single seek
+	bool seek = true;
+	for (u32 i = 0; i < m_index.size(); ++i)
+	{
+		if (!m_changed[i])
+		{
+			seek = true;
+			continue;
+		}
+		if (seek && !m_file.Seek(sizeof(Header) + i * sizeof(IndexEntry), SEEK_SET))
+			return false;
+		seek = false;
+		if (!m_file.WriteArray(&m_index[i], 1))
+			return false;
+	}
+	// until then the entries are written again by the next Commit
+	if (!m_file.Sync())
+		return false;
+	m_changed.assign(m_index.size(), false);
+	return true;
+}
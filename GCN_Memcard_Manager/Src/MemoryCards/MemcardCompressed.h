@@ -0,0 +1,91 @@
+// Copyright (C) 2003 Dolphin Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official SVN repository and contact information can be found at
+// http://code.google.com/p/dolphin-emu/
+
+#ifndef __MEMCARDCOMPRESSED_h__
+#define __MEMCARDCOMPRESSED_h__
+
+#include <string>
+#include <vector>
+
+#include "Common.h"
+#include "FileUtil.h"
+
+// A memory card image (.mcz) with every 8 KiB block compressed on its own,
+// so any block can be read without touching the others.
+//
+// The file is a header, an index with the offset and size of every block
+// of the card (system blocks included) and the block data. A block of
+// size 0 is erased (all 0xFF) and has no data, one of BLOCK_SIZE didn't
+// compress and is stored as it is, anything else is a zlib stream.
+//
+// Blocks are only ever appended: writing a block adds its new data at the
+// end of the file and Commit then points its index entry at it. Until
+// then the entry, and the card, still has the old block.
+class GCMemcardCompressed : NonCopyable
+{
+public:
+	GCMemcardCompressed();
+
+	// true for the .mcz extension
+	static bool IsCompressedName(const std::string &fileName);
+
+	// reads the index of an existing file, forWrite also allows WriteBlock
+	bool Open(const std::string &fileName, bool forWrite = false);
+	// creates fileName for a card of numBlocks blocks, all of them erased
+	bool Create(const std::string &fileName, u16 numBlocks);
+	bool IsOpen() { return m_file.IsOpen(); }
+	bool Close();
+
+	u16 GetNumBlocks() const { return (u16)m_index.size(); }
+	// true if most of the file is blocks that were written again since
+	bool IsFragmented() const;
+
+	bool ReadBlock(u16 block, u8 *dest);
+	// appends the block, its index entry is written by Commit
+	bool WriteBlock(u16 block, const u8 *src);
+	// makes the blocks written since the last Commit part of the card:
+	// their data is synced to disk before their index entries are written
+	bool Commit();
+
+private:
+	struct Header
+	{
+		u32 magic;
+		u32 version;
+		u32 numBlocks;
+		u32 pad;
+	};
+
+	struct IndexEntry
+	{
+		u32 offset;
+		u32 size;
+	};
+
+	u64 GetDataStart() const { return sizeof(Header) + m_index.size() * sizeof(IndexEntry); }
+
+	File::IOFile m_file;
+	std::vector<IndexEntry> m_index;
+	// index entries WriteBlock changed since the last Commit
+	std::vector<bool> m_changed;
+	u64 m_fileSize;
+	// data size of the blocks in m_index
+	u64 m_usedSize;
+	std::vector<u8> m_buffer;
+};
+
+#endif
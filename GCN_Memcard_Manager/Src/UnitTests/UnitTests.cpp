@@ -0,0 +1,452 @@
+// Copyright (C) 2003 Dolphin Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official SVN repository and contact information can be found at
+// http://code.google.com/p/dolphin-emu/
+
+// gcmc-tests - checks every SIMD version of the image decoders and the
+// checksums against the scalar one, and that cards come back the same after
+// a save, including saves that stopped halfway. "scons test" builds and
+// runs it, the exit code is the number of failed checks.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Common.h"
+#include "ColorUtil.h"
+#include "CPUDetect.h"
+#include "FileUtil.h"
+#include "StringUtil.h"
+#include "MemoryCards/GCMemcard.h"
+
+static int failures = 0;
+
+#define EXPECT(x) \
+	do { if (!(x)) { ++failures; printf("%s:%d: %s failed\n", __FILE__, __LINE__, #x); } } while (0)
+
+static bool QuietMsgAlert(const char* /*caption*/, const char* /*text*/, bool yes_no, int /*Style*/)
+{
+	return !yes_no;
+}
+
+// the code paths the cpu_info flags select, each one is tested if the CPU has it
+struct CPUVersion
+{
+	const char *name;
+	bool sse2, ssse3, avx2;
+};
+static const CPUVersion cpuVersions[] = {
+	{ "scalar", false, false, false },
+	{ "SSE2", true, false, false },
+	{ "SSSE3", true, true, false },
+	{ "AVX2", true, true, true },
+};
+static CPUInfo detectedCPU;
+
+static bool UseCPUVersion(const CPUVersion &version)
+{
+	if ((version.sse2 && !detectedCPU.bSSE2) || (version.ssse3 && !detectedCPU.bSSSE3) ||
+		(version.avx2 && !detectedCPU.bAVX2))
+	{
+		return false;
+	}
+	cpu_info.bSSE2 = version.sse2;
+	cpu_info.bSSSE3 = version.ssse3;
+	cpu_info.bAVX2 = version.avx2;
+	return true;
+}
+
+static u32 rngState = 1;
+static u32 Random()
+{
+	rngState = rngState * 1103515245 + 12345;
+	return rngState >> 8;
+}
+
+// every RGB5A3 value through decodePalette, decode5A3image and decodeCI8image
+static void TestDecode5A3()
+{
+	// all 65536 values, big endian like the card has them
+	std::vector<u16> values(0x10000);
+	std::vector<u32> expected(0x10000);
+	for (u32 i = 0; i < 0x10000; ++i)
+	{
+		values[i] = Common::swap16((u16)i);
+		expected[i] = ColorUtil::Decode5A3((u16)i);
+	}
+
+	// the tiles of a 256x256 image hold the values in order
+	std::vector<u32> expectedImage(0x10000);
+	u32 n = 0;
+	for (int y = 0; y < 256; y += 4)
+		for (int x = 0; x < 256; x += 4)
+			for (int iy = 0; iy < 4; ++iy)
+				for (int ix = 0; ix < 4; ++ix)
+					expectedImage[(y + iy) * 256 + x + ix] = expected[n++];
+
+	std::vector<u8> ci8(96 * 32);
+	for (u32 i = 0; i < ci8.size(); ++i)
+		ci8[i] = (u8)Random();
+
+	for (u32 v = 0; v < ARRAYSIZE(cpuVersions); ++v)
+	{
+		if (!UseCPUVersion(cpuVersions[v]))
+		{
+			printf("  %s: not supported by this CPU, skipped\n", cpuVersions[v].name);
+			continue;
+		}
+		const int oldFailures = failures;
+
+		std::vector<u32> decoded(0x10000);
+		for (u32 i = 0; i < 0x10000; i += 256)
+			ColorUtil::decodePalette(&decoded[i], &values[i]);
+		EXPECT(decoded == expected);
+
+		// and the sizes of the banner and the icons
+		ColorUtil::decode5A3image(&decoded[0], &values[0], 256, 256);
+		EXPECT(decoded == expectedImage);
+		for (int size = 0; size < 2; ++size)
+		{
+			const int width = size ? 96 : 32, height = 32;
+			std::vector<u32> image(width * height);
+			ColorUtil::decode5A3image(&image[0], &values[0x1234], width, height);
+			n = 0x1234;
+			for (int y = 0; y < height; y += 4)
+				for (int x = 0; x < width; x += 4)
+					for (int iy = 0; iy < 4; ++iy)
+						for (int ix = 0; ix < 4; ++ix)
+							EXPECT(image[(y + iy) * width + x + ix] == expected[n++]);
+		}
+
+		// CI8 tiles are 8x4
+		std::vector<u32> image(96 * 32);
+		ColorUtil::decodeCI8image(&image[0], &ci8[0], &values[0xA500], 96, 32);
+		n = 0;
+		for (int y = 0; y < 32; y += 4)
+			for (int x = 0; x < 96; x += 8)
+				for (int iy = 0; iy < 4; ++iy)
+					for (int ix = 0; ix < 8; ++ix)
+						EXPECT(image[(y + iy) * 96 + x + ix] == expected[0xA500 + ci8[n++]]);
+
+		printf("  %s: %s\n", cpuVersions[v].name, failures == oldFailures ? "ok" : "FAILED");
+	}
+	cpu_info = detectedCPU;
+}
+
+// calc_checksumsBE over every length a system block has, and the odd ones
+// the SIMD loops leave over
+static void TestChecksums()
+{
+	std::vector<u16> buf(BLOCK_SIZE / 2);
+	for (u32 i = 0; i < buf.size(); ++i)
+		buf[i] = (u16)Random();
+
+	for (u32 v = 0; v < ARRAYSIZE(cpuVersions); ++v)
+	{
+		if (!UseCPUVersion(cpuVersions[v]))
+			continue;
+		const int oldFailures = failures;
+		for (u32 length = 0; length <= buf.size(); length += (length < 64) ? 1 : 61)
+		{
+			u16 sum = 0, inv = 0;
+			for (u32 i = 0; i < length; ++i)
+			{
+				sum += Common::swap16(buf[i]);
+				inv += Common::swap16(buf[i]) ^ 0xFFFF;
+			}
+			u16 csum, inv_csum;
+			GCMemcard::calc_checksumsBE(&buf[0], length, &csum, &inv_csum);
+			// stored big endian, 0xFFFF as 0
+			EXPECT(Common::swap16(csum) == (sum == 0xFFFF ? 0 : sum));
+			EXPECT(Common::swap16(inv_csum) == (inv == 0xFFFF ? 0 : inv));
+		}
+		printf("  %s: %s\n", cpuVersions[v].name, failures == oldFailures ? "ok" : "FAILED");
+	}
+	cpu_info = detectedCPU;
+}
+
+static std::string testDir;
+
+// a .gci with blocks blocks of random data
+static std::string MakeGci(const char *name, u16 blocks)
+{
+	std::string gci(DENTRY_SIZE + blocks * BLOCK_SIZE, '\0');
+	memset(&gci[0], 0xFF, DENTRY_SIZE);
+	memcpy(&gci[0], "GTSE01", 6);	// Gamecode and Makercode
+	gci[0x07] = 0;					// no banner
+	memset(&gci[0x08], 0, DENTRY_STRLEN);
+	memcpy(&gci[0x08], name, strlen(name));
+	memset(&gci[0x28], 0, 12);		// ModTime, ImageOffset, no icons
+	gci[0x34] = 4;					// public
+	gci[0x35] = 0;
+	gci[0x38] = (char)(blocks >> 8);
+	gci[0x39] = (char)blocks;
+	memset(&gci[0x3c], 0, 4);		// comments at the start of the save
+	for (u32 i = DENTRY_SIZE; i < gci.size(); ++i)
+		gci[i] = (char)Random();
+
+	const std::string fileName = testDir + name + ".gci";
+	EXPECT(File::WriteStringToFile(false, gci, fileName.c_str()));
+	return fileName;
+}
+
+static std::string ReadFile(const std::string &fileName)
+{
+	std::string data;
+	File::ReadFileToString(false, fileName.c_str(), data);
+	return data;
+}
+
+// the saves on the card, with each one's .gci as ExportGci writes it
+static std::string DescribeCard(const std::string &cardName, u8 loadMode)
+{
+	GCMemcard card(cardName.c_str(), false, false, MemCard2043Mb, loadMode);
+	if (!card.IsValid())
+		return "not a card";
+
+	std::string description = StringFromFormat("%d blocks free;", card.GetFreeBlocks());
+	for (u8 i = 0; i < card.GetNumFiles(); ++i)
+	{
+		const u8 index = card.GetFileIndex(i);
+		std::string fileName;
+		card.GCI_FileName(index, fileName);
+		const std::string gciName = testDir + "export.gci";
+		EXPECT(card.ExportGci(index, gciName.c_str(), "") == SUCCESS);
+		description += fileName + ":" + ReadFile(gciName) + ";";
+	}
+
+	// a restored copy is reported, everything else is a failure
+	std::vector<std::string> problems;
+	card.CheckFileSystem(problems);
+	for (u32 i = 0; i < problems.size(); ++i)
+	{
+		if (problems[i].find("restored") == std::string::npos)
+		{
+			printf("  %s: %s\n", cardName.c_str(), problems[i].c_str());
+			description += "problem;";
+		}
+	}
+	return description;
+}
+
+static bool SaveCard(GCMemcard &card)
+{
+	card.FixChecksums();
+	return card.Save();
+}
+
+// import, delete and save as every kind of card file, reloading with every load mode
+static void TestRoundTrip()
+{
+	const std::string cardName = testDir + "card.raw";
+	{
+		GCMemcard card(cardName.c_str(), true, false, MemCard251Mb);
+		EXPECT(card.IsValid());
+		for (int i = 0; i < 8; ++i)
+			EXPECT(card.ImportGci(MakeGci(StringFromFormat("save%d", i).c_str(), 1 + i * 3).c_str(), "") == SUCCESS);
+		EXPECT(SaveCard(card));
+	}
+	const std::string saved = DescribeCard(cardName, GCMemcard::LOAD_FULL);
+	for (int i = 0; i < 8; ++i)
+	{
+		const std::string name = StringFromFormat("save%d", i);
+		const std::string gci = ReadFile(testDir + name + ".gci");
+		// the card counts the copy and sets FirstBlock, the rest is the same
+		const size_t found = saved.find("GTSE_" + name + ".gci:");
+		EXPECT(found != std::string::npos);
+		if (found != std::string::npos)
+		{
+			const std::string exported = saved.substr(found + name.size() + 10, gci.size());
+			EXPECT(exported.compare(0, 0x35, gci, 0, 0x35) == 0);
+			EXPECT(exported[0x35] == gci[0x35] + 1);
+			EXPECT(exported.compare(0x38, std::string::npos, gci, 0x38, std::string::npos) == 0);
+		}
+	}
+	EXPECT(DescribeCard(cardName, GCMemcard::LOAD_MMAP) == saved);
+	EXPECT(DescribeCard(cardName, GCMemcard::LOAD_LAZY) == saved);
+
+	// an in-place save of a delete and an import
+	std::string changed;
+	{
+		GCMemcard card(cardName.c_str(), false, false, MemCard2043Mb, GCMemcard::LOAD_LAZY);
+		EXPECT(card.RemoveFile(card.GetFileIndex(2)) == SUCCESS);
+		EXPECT(card.ImportGci(MakeGci("new", 9).c_str(), "") == SUCCESS);
+		EXPECT(SaveCard(card));
+		changed = DescribeCard(cardName, GCMemcard::LOAD_FULL);
+		EXPECT(changed != saved);
+	}
+	EXPECT(DescribeCard(cardName, GCMemcard::LOAD_MMAP) == changed);
+	EXPECT(DescribeCard(cardName, GCMemcard::LOAD_LAZY) == changed);
+
+	const char *const extensions[] = { ".mci", ".mcz" };
+	for (u32 i = 0; i < ARRAYSIZE(extensions); ++i)
+	{
+		const std::string copyName = testDir + "copy" + extensions[i];
+		{
+			GCMemcard card(cardName.c_str());
+			EXPECT(card.SaveAs(copyName.c_str()));
+		}
+		EXPECT(DescribeCard(copyName, GCMemcard::LOAD_FULL) == changed);
+		EXPECT(DescribeCard(copyName, GCMemcard::LOAD_LAZY) == changed);
+
+		GCMemcard card(copyName.c_str(), false, false, MemCard2043Mb, GCMemcard::LOAD_LAZY);
+		EXPECT(card.RemoveFile(card.GetFileIndex(0)) == SUCCESS);
+		EXPECT(SaveCard(card));
+		EXPECT(DescribeCard(copyName, GCMemcard::LOAD_FULL) != changed);
+	}
+}
+
+// every point an in-place save of change could have stopped at, as the
+// card file would be on disk then: the data blocks are written first, then
+// the system blocks one at a time. Each one has to load as the card before
+// or after the save, and take a new save without reusing blocks
+static void TestInterruptedSave(const std::string &cardName, void (*change)(GCMemcard &card))
+{
+	const std::string before = ReadFile(cardName);
+	const std::string describedBefore = DescribeCard(cardName, GCMemcard::LOAD_FULL);
+	{
+		GCMemcard card(cardName.c_str(), false, false, MemCard2043Mb, GCMemcard::LOAD_LAZY);
+		change(card);
+		EXPECT(SaveCard(card));
+	}
+	const std::string after = ReadFile(cardName);
+	const std::string describedAfter = DescribeCard(cardName, GCMemcard::LOAD_FULL);
+	EXPECT(after.size() == before.size());
+	if (after.size() != before.size())
+		return;
+
+	std::vector<u16> systemBlocks;
+	for (u16 i = 0; i < MC_FST_BLOCKS; ++i)
+		if (before.compare(i * BLOCK_SIZE, BLOCK_SIZE, after, i * BLOCK_SIZE, BLOCK_SIZE))
+			systemBlocks.push_back(i);
+	// one directory and one BAT, see CanSaveInPlace
+	EXPECT(systemBlocks.size() == 2);
+
+	std::string state = before;
+	state.replace(MC_FST_BLOCK_SIZE, std::string::npos, after, MC_FST_BLOCK_SIZE, std::string::npos);
+	const std::string stateName = testDir + "interrupted.raw";
+	for (u32 i = 0; i <= systemBlocks.size(); ++i)
+	{
+		std::vector<std::string> states;
+		states.push_back(state);
+		if (i < systemBlocks.size())
+		{
+			// stopped in the middle of the block, with garbage where it stopped
+			std::string torn = state;
+			torn.replace(systemBlocks[i] * BLOCK_SIZE, BLOCK_SIZE / 2, after, systemBlocks[i] * BLOCK_SIZE, BLOCK_SIZE / 2);
+			torn.replace(systemBlocks[i] * BLOCK_SIZE + BLOCK_SIZE / 2, 16, 16, '\xAB');
+			states.push_back(torn);
+			state.replace(systemBlocks[i] * BLOCK_SIZE, BLOCK_SIZE, after, systemBlocks[i] * BLOCK_SIZE, BLOCK_SIZE);
+		}
+
+		for (u32 s = 0; s < states.size(); ++s)
+		{
+			EXPECT(File::WriteStringToFile(false, states[s], stateName.c_str()));
+			const std::string expected = (i == systemBlocks.size()) ? describedAfter : describedBefore;
+			EXPECT(DescribeCard(stateName, GCMemcard::LOAD_FULL) == expected);
+			EXPECT(DescribeCard(stateName, GCMemcard::LOAD_MMAP) == expected);
+			EXPECT(DescribeCard(stateName, GCMemcard::LOAD_LAZY) == expected);
+
+			GCMemcard card(stateName.c_str(), false, false, MemCard2043Mb, GCMemcard::LOAD_LAZY);
+			EXPECT(card.ImportGci(MakeGci("extra", 7).c_str(), "") == SUCCESS);
+			EXPECT(SaveCard(card));
+			std::vector<std::string> problems;
+			GCMemcard reloaded(stateName.c_str());
+			EXPECT(reloaded.CheckFileSystem(problems) == SUCCESS);
+		}
+	}
+}
+
+static void ImportSave(GCMemcard &card)
+{
+	static int imported = 0;
+	EXPECT(card.ImportGci(MakeGci(StringFromFormat("imported%d", imported++).c_str(), 5).c_str(), "") == SUCCESS);
+}
+
+static void DeleteSave(GCMemcard &card)
+{
+	EXPECT(card.RemoveFile(card.GetFileIndex(1)) == SUCCESS);
+}
+
+static void TestInterruptedSaves()
+{
+	const std::string cardName = testDir + "interrupt.raw";
+	{
+		GCMemcard card(cardName.c_str(), true, false, MemCard251Mb);
+		for (int i = 0; i < 4; ++i)
+			EXPECT(card.ImportGci(MakeGci(StringFromFormat("old%d", i).c_str(), 2 + i).c_str(), "") == SUCCESS);
+		EXPECT(SaveCard(card));
+	}
+	// twice each, so both copies of the directory and the BAT get written
+	for (int i = 0; i < 2; ++i)
+	{
+		TestInterruptedSave(cardName, ImportSave);
+		TestInterruptedSave(cardName, DeleteSave);
+	}
+}
+
+// a damaged copy that the last save didn't write is replaced by the other
+// one, and the card stays as it is
+static void TestDamagedOlderCopies()
+{
+	const std::string cardName = testDir + "interrupt.raw";
+	const std::string card = ReadFile(cardName);
+	const std::string described = DescribeCard(cardName, GCMemcard::LOAD_FULL);
+
+	// UpdateCounter is at the end of a directory and after the checksums of a BAT
+	const u16 blocks[2] = { 1, 3 };
+	const u32 counterOffsets[2] = { BLOCK_SIZE - 6, 4 };
+	for (int i = 0; i < 2; ++i)
+	{
+		const u32 first = blocks[i] * BLOCK_SIZE + counterOffsets[i];
+		const u32 second = first + BLOCK_SIZE;
+		const u16 firstCounter = ((u8)card[first] << 8) | (u8)card[first + 1];
+		const u16 secondCounter = ((u8)card[second] << 8) | (u8)card[second + 1];
+		const u16 older = (firstCounter > secondCounter) ? blocks[i] + 1 : blocks[i];
+
+		std::string damaged = card;
+		damaged[older * BLOCK_SIZE + BLOCK_SIZE / 2] ^= 1;
+		const std::string damagedName = testDir + "damaged.raw";
+		EXPECT(File::WriteStringToFile(false, damaged, damagedName.c_str()));
+		EXPECT(DescribeCard(damagedName, GCMemcard::LOAD_FULL) == described);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	RegisterMsgAlertHandler(&QuietMsgAlert);
+	detectedCPU = cpu_info;
+	testDir = File::GetCurrentDir() + DIR_SEP "gcmc-tests.tmp" DIR_SEP;
+	File::DeleteDirRecursively(testDir);
+	if (!File::CreateFullPath(testDir))
+	{
+		printf("could not create %s\n", testDir.c_str());
+		return 1;
+	}
+
+	printf("Decode5A3\n");
+	TestDecode5A3();
+	printf("Checksums\n");
+	TestChecksums();
+	printf("Round trip\n");
+	TestRoundTrip();
+	printf("Interrupted saves\n");
+	TestInterruptedSaves();
+	printf("Damaged copies\n");
+	TestDamagedOlderCopies();
+
+	File::DeleteDirRecursively(testDir);
+	printf("%d failed\n", failures);
+	return failures;
+}
@@ -0,0 +1,773 @@
+// Copyright (C) 2003 Dolphin Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official SVN repository and contact information can be found at
+// http://code.google.com/p/dolphin-emu/
+
+// gcmc - command line front end for the memory card core, no GUI required.
+// Alerts from the core are printed to stderr and questions are answered
+// with "no", so it never blocks waiting for the user.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Common.h"
+#include "ColorUtil.h"
+#include "CPUDetect.h"
+#include "FileUtil.h"
+#include "StringUtil.h"
+#include "Timer.h"
+#include "MemoryCards/GCMemcard.h"
+#include "MemoryCards/MemcardArchive.h"
+#include "MemoryCards/MemcardBatch.h"
+
+// exit codes
+enum
+{
+	GCMC_OK = 0,
+	GCMC_USAGE,
+	GCMC_ERROR,
+};
+
+static bool quiet = false;
+
+static bool ConsoleMsgAlert(const char* caption, const char* text, bool yes_no, int /*Style*/)
+{
+	if (!quiet)
+		fprintf(stderr, "%s: %s\n", caption, text);
+	return !yes_no;
+}
+
+static const char* ResultString(u32 result)
+{
+	switch (result)
+	{
+	case SUCCESS:			return "success";
+	case NOMEMCARD:			return "no valid memory card";
+	case OPENFAIL:			return "could not open the file";
+	case OUTOFBLOCKS:		return "not enough free blocks";
+	case OUTOFDIRENTRIES:	return "no free directory entries";
+	case LENGTHFAIL:		return "file length does not match its block count";
+	case INVALIDFILESIZE:	return "invalid file size";
+	case TITLEPRESENT:		return "the save is already on the memory card";
+	case SAVFAIL:			return "invalid .sav file";
+	case GCSFAIL:			return "invalid .gcs file";
+	case FAIL:				return "invalid save data";
+	case WRITEFAIL:			return "write failed";
+	case DELETE_FAIL:		return "delete failed";
+	case READFAIL:			return "read failed";
+	case INVALIDEXTENSION:	return "unknown extension, memory cards are .raw/.gcp/.mci/.mcz";
+	case INVALIDHEADER:		return "invalid header";
+	case CHECKSUMFAIL:		return "checksum failed";
+	default:				return "unknown error";
+	}
+}
+
+static void Usage()
+{
+	printf(
+		"usage: gcmc [-q] [-j threads] <command> <card> [args]\n"
+		"\n"
+		"  list <card>                          list the saves on the card\n"
+		"  export <card> <dir> [save...]        export saves as .gci, all if none are given\n"
+		"  export <card> <file.tar>             export every save as .gci into one tar file\n"
+		"  import <card> <file...>              import .gci/.gcs/.sav files, all of them or none\n"
+		"  delete <card> <save...>              delete saves\n"
+		"  copy <card> <source card> <save...>  copy saves from the source card\n"
+		"  fsck <card> [--fix]                  check the file system, --fix writes\n"
+		"                                       back repaired directory/BAT blocks\n"
+		"  format <card> [blocks] [--sjis]      create or format a card (default 2043 blocks)\n"
+		"  resize <card> <blocks>               change the card size\n"
+		"  defrag <card>                        store every save in one run of blocks\n"
+		"  convert <save> <save>                convert between .gci/.gcs/.sav by extension\n"
+		"  convert <dir> <dir> .gci|.gcs|.sav   convert every save in a directory\n"
+		"  batch load|validate|fix <card|dir...>\n"
+		"  batch export <dir> <card|dir...>     run one operation over many cards, directories\n"
+		"                                       are searched for .raw/.gcp/.mci/.mcz files\n"
+		"  archive add <archive> <card...>      store cards in an archive directory, blocks\n"
+		"                                       shared between cards are stored once\n"
+		"  archive extract <archive> <name> <card>\n"
+		"  archive list <archive>\n"
+		"  bench [iterations]                   time the scalar and SIMD image decoders\n"
+		"\n"
+		"A save is its number in the list output or its .gci file name.\n"
+		"Sizes are in usable blocks: 59, 123, 251, 507, 1019 or 2043.\n"
+		"-q hides the messages of the memory card code.\n"
+		"-j sets the number of batch threads, the default is one per CPU, and of\n"
+		"   the threads that write the files when every save is exported.\n"
+		"Exits with 0 on success, 1 for usage errors and 2 if an operation failed.\n");
+}
+
+static bool ParseCardSize(const char* arg, u16 &sizeMb)
+{
+	const u16 sizes[] = { MemCard59Mb, MemCard123Mb, MemCard251Mb, Memcard507Mb, MemCard1019Mb, MemCard2043Mb };
+	int blocks = atoi(arg);
+	for (u32 i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+	{
+		if (blocks == sizes[i] * MBIT_TO_BLOCKS - MC_FST_BLOCKS)
+		{
+			sizeMb = sizes[i];
+			return true;
+		}
+	}
+	fprintf(stderr, "Invalid card size: %s\n", arg);
+	return false;
+}
+
+// returns the directory index of a save given as its list number or .gci name
+static bool FindSave(const GCMemcard& card, const char* arg, u8 &index)
+{
+	char* end;
+	long fileNumber = strtol(arg, &end, 10);
+	if (*arg && !*end)
+	{
+		if (fileNumber >= 0 && fileNumber < card.GetNumFiles())
+		{
+			index = card.GetFileIndex((u8)fileNumber);
+			return true;
+		}
+	}
+	else
+	{
+		for (u8 i = 0; i < DIRLEN; ++i)
+		{
+			std::string fileName;
+			if (card.GCI_FileName(i, fileName) && !strcasecmp(fileName.c_str(), arg))
+			{
+				index = i;
+				return true;
+			}
+		}
+	}
+	fprintf(stderr, "%s: no such save\n", arg);
+	return false;
+}
+
+static bool OpenCard(GCMemcard& card, const char* fileName)
+{
+	if (card.IsValid())
+		return true;
+	fprintf(stderr, "%s: %s\n", fileName, ResultString(card.GetLoadResult()));
+	return false;
+}
+
+static bool SaveCard(GCMemcard& card, const char* fileName)
+{
+	card.FixChecksums();
+	if (card.Save())
+		return true;
+	fprintf(stderr, "%s: %s\n", fileName, ResultString(WRITEFAIL));
+	return false;
+}
+
+static std::string TrimString(const std::string& str)
+{
+	return std::string(str.c_str());
+}
+
+static int List(const char* cardName)
+{
+	// the read only commands map the card, only the blocks they read are paged in
+	GCMemcard card(cardName, false, false, MemCard2043Mb, GCMemcard::LOAD_MMAP);
+	if (!OpenCard(card, cardName))
+		return GCMC_ERROR;
+
+	printf("# %d saves, %d of %d blocks free\n", card.GetNumFiles(), card.GetFreeBlocks(),
+		card.GetSize() * MBIT_TO_BLOCKS - MC_FST_BLOCKS);
+	for (u8 i = 0; i < card.GetNumFiles(); ++i)
+	{
+		u8 index = card.GetFileIndex(i);
+		std::string fileName;
+		card.GCI_FileName(index, fileName);
+		printf("%d\t%s\t%s\t%d\t%s\t%s\n", i, card.DEntry_GameCode(index).c_str(),
+			card.DEntry_Makercode(index).c_str(), card.DEntry_BlockCount(index), fileName.c_str(),
+			TrimString(card.GetSaveComment1(index)).c_str());
+	}
+	return GCMC_OK;
+}
+
+static int ExportAll(GCMemcard& card, const char* destination, u32 numThreads)
+{
+	GCMemcard::ExportReport report;
+	card.ExportAll(destination, report, numThreads);
+	int ret = GCMC_OK;
+	for (u32 i = 0; i < report.saves.size(); ++i)
+	{
+		const GCMemcard::ExportReport::Save &save = report.saves[i];
+		if (save.result != SUCCESS)
+		{
+			fprintf(stderr, "%s: %s\n", save.fileName.c_str(), ResultString(save.result));
+			ret = GCMC_ERROR;
+		}
+		else if (!quiet)
+		{
+			printf("%s\n", save.fileName.c_str());
+		}
+	}
+	return ret;
+}
+
+static int Export(const char* cardName, const char* directory, u32 numThreads, int numSaves, char** saves)
+{
+	GCMemcard card(cardName, false, false, MemCard2043Mb, GCMemcard::LOAD_MMAP);
+	if (!OpenCard(card, cardName))
+		return GCMC_ERROR;
+
+	std::string extension;
+	SplitPath(directory, NULL, NULL, &extension);
+	bool tar = !strcasecmp(extension.c_str(), ".tar");
+	if (numSaves == 0)
+		return ExportAll(card, directory, numThreads);
+	if (tar)
+	{
+		fprintf(stderr, "%s: a .tar always gets every save\n", directory);
+		return GCMC_USAGE;
+	}
+
+	std::vector<u8> indices;
+	for (int i = 0; i < numSaves; ++i)
+	{
+		u8 index;
+		if (!FindSave(card, saves[i], index))
+			return GCMC_ERROR;
+		indices.push_back(index);
+	}
+
+	if (!File::IsDirectory(directory) && !File::CreateFullPath(std::string(directory) + DIR_SEP))
+	{
+		fprintf(stderr, "%s: could not create the directory\n", directory);
+		return GCMC_ERROR;
+	}
+
+	int ret = GCMC_OK;
+	for (u32 i = 0; i < indices.size(); ++i)
+	{
+		std::string fileName;
+		card.GCI_FileName(indices[i], fileName);
+		u32 result = card.ExportGci(indices[i], NULL, directory);
+		if (result != SUCCESS)
+		{
+			fprintf(stderr, "%s: %s\n", fileName.c_str(), ResultString(result));
+			ret = GCMC_ERROR;
+		}
+		else if (!quiet)
+		{
+			printf("%s\n", fileName.c_str());
+		}
+	}
+	return ret;
+}
+
+static int Import(const char* cardName, int numFiles, char** files)
+{
+	GCMemcard card(cardName, false, false, MemCard2043Mb, GCMemcard::LOAD_LAZY);
+	if (!OpenCard(card, cardName))
+		return GCMC_ERROR;
+
+	std::vector<std::string> fileNames(files, files + numFiles);
+	std::vector<u32> results;
+	u32 result = card.ImportBatch(fileNames, results);
+	if (result != SUCCESS)
+	{
+		// nothing was imported, either because of the files that failed or
+		// because all of them don't fit
+		bool reported = false;
+		for (int i = 0; i < numFiles; ++i)
+		{
+			if (results[i] != SUCCESS)
+			{
+				fprintf(stderr, "%s: %s\n", files[i], ResultString(results[i]));
+				reported = true;
+			}
+		}
+		if (!reported)
+			fprintf(stderr, "%s: %s\n", cardName, ResultString(result));
+		return GCMC_ERROR;
+	}
+	return SaveCard(card, cardName) ? GCMC_OK : GCMC_ERROR;
+}
+
+static int Delete(const char* cardName, int numSaves, char** saves)
+{
+	GCMemcard card(cardName, false, false, MemCard2043Mb, GCMemcard::LOAD_LAZY);
+	if (!OpenCard(card, cardName))
+		return GCMC_ERROR;
+
+	// look all of them up first, deleting does not move the other saves
+	// but it does change the list numbers
+	std::vector<u8> indices;
+	for (int i = 0; i < numSaves; ++i)
+	{
+		u8 index;
+		if (!FindSave(card, saves[i], index))
+			return GCMC_ERROR;
+		indices.push_back(index);
+	}
+
+	int ret = GCMC_OK;
+	for (u32 i = 0; i < indices.size(); ++i)
+	{
+		u32 result = card.RemoveFile(indices[i]);
+		if (result != SUCCESS)
+		{
+			fprintf(stderr, "%s: %s\n", saves[i], ResultString(result));
+			ret = GCMC_ERROR;
+		}
+	}
+	if (!SaveCard(card, cardName))
+		return GCMC_ERROR;
+	return ret;
+}
+
+static int Copy(const char* cardName, const char* sourceName, int numSaves, char** saves)
+{
+	GCMemcard card(cardName, false, false, MemCard2043Mb, GCMemcard::LOAD_LAZY);
+	if (!OpenCard(card, cardName))
+		return GCMC_ERROR;
+	GCMemcard source(sourceName, false, false, MemCard2043Mb, GCMemcard::LOAD_MMAP);
+	if (!OpenCard(source, sourceName))
+		return GCMC_ERROR;
+
+	int ret = GCMC_OK;
+	for (int i = 0; i < numSaves; ++i)
+	{
+		u8 index;
+		if (!FindSave(source, saves[i], index))
+		{
+			ret = GCMC_ERROR;
+			continue;
+		}
+		u32 result = card.CopyFrom(source, index);
+		if (result != SUCCESS)
+		{
+			fprintf(stderr, "%s: %s\n", saves[i], ResultString(result));
+			ret = GCMC_ERROR;
+		}
+	}
+	if (!SaveCard(card, cardName))
+		return GCMC_ERROR;
+	return ret;
+}
+
+static int Fsck(const char* cardName, bool fix)
+{
+	// Save writes into the file the mapping would still be reading from
+	GCMemcard card(cardName, false, false, MemCard2043Mb, fix ? GCMemcard::LOAD_LAZY : GCMemcard::LOAD_MMAP);
+	if (!OpenCard(card, cardName))
+		return GCMC_ERROR;
+
+	std::vector<std::string> problems;
+	card.CheckFileSystem(problems);
+	for (u32 i = 0; i < problems.size(); ++i)
+		printf("%s: %s\n", cardName, problems[i].c_str());
+
+	// Loading already replaced a broken directory or BAT with the good copy,
+	// fixing the checksums and saving writes the repaired blocks back
+	if (fix && card.IsModified() && !SaveCard(card, cardName))
+		return GCMC_ERROR;
+	return problems.empty() ? GCMC_OK : GCMC_ERROR;
+}
+
+static int Format(const char* cardName, u16 sizeMb, bool sjis)
+{
+	if (File::Exists(cardName))
+	{
+		GCMemcard card(cardName, false, false, sizeMb, GCMemcard::LOAD_LAZY);
+		if (card.Format(sjis, sizeMb))
+			return GCMC_OK;
+	}
+	else
+	{
+		GCMemcard card(cardName, true, sjis, sizeMb);
+		if (card.IsValid())
+			return GCMC_OK;
+	}
+	fprintf(stderr, "%s: %s\n", cardName, ResultString(WRITEFAIL));
+	return GCMC_ERROR;
+}
+
+static int Resize(const char* cardName, u16 sizeMb)
+{
+	GCMemcard card(cardName, false, false, MemCard2043Mb, GCMemcard::LOAD_LAZY);
+	if (!OpenCard(card, cardName))
+		return GCMC_ERROR;
+
+	// ChangeMemoryCardSize reports why it failed itself
+	return card.ChangeMemoryCardSize(sizeMb) ? GCMC_OK : GCMC_ERROR;
+}
+
+static int Defrag(const char* cardName)
+{
+	GCMemcard card(cardName, false, false, MemCard2043Mb, GCMemcard::LOAD_LAZY);
+	if (!OpenCard(card, cardName))
+		return GCMC_ERROR;
+
+	u16 movedBlocks;
+	u8 movedFiles;
+	u32 result = card.Defragment(movedBlocks, movedFiles);
+	if (result != SUCCESS)
+	{
+		fprintf(stderr, "%s: %s\n", cardName, ResultString(result));
+		return GCMC_ERROR;
+	}
+	if (!quiet)
+		printf("%d blocks of %d saves moved, %d saves already in place\n",
+			movedBlocks, movedFiles, card.GetNumFiles() - movedFiles);
+	if (movedBlocks && !SaveCard(card, cardName))
+		return GCMC_ERROR;
+	return GCMC_OK;
+}
+
+static int Convert(const char* input, const char* output, const char* extension)
+{
+	if (!extension)
+	{
+		u32 result = GCMemcard::ConvertSave(input, output);
+		if (result != SUCCESS)
+		{
+			fprintf(stderr, "%s: %s\n", input, ResultString(result));
+			return GCMC_ERROR;
+		}
+		return GCMC_OK;
+	}
+
+	std::vector<std::string> fileNames;
+	std::vector<u32> results;
+	u32 result = GCMemcard::ConvertSaves(input, output, extension, fileNames, results);
+	for (u32 i = 0; i < fileNames.size(); ++i)
+	{
+		if (results[i] != SUCCESS)
+			fprintf(stderr, "%s: %s\n", fileNames[i].c_str(), ResultString(results[i]));
+		else if (!quiet)
+			printf("%s\n", fileNames[i].c_str());
+	}
+	return result == SUCCESS ? GCMC_OK : GCMC_ERROR;
+}
+
+static int Batch(const char* operationName, u32 numThreads, int numArgs, char** args)
+{
+	u8 operation;
+	std::string exportDirectory;
+	if (!strcmp(operationName, "load"))
+		operation = GCMemcardBatch::BATCH_LOAD;
+	else if (!strcmp(operationName, "validate"))
+		operation = GCMemcardBatch::BATCH_VALIDATE;
+	else if (!strcmp(operationName, "fix"))
+		operation = GCMemcardBatch::BATCH_FIXCHECKSUMS;
+	else if (!strcmp(operationName, "export") && numArgs >= 2)
+	{
+		operation = GCMemcardBatch::BATCH_EXPORT;
+		exportDirectory = args[0];
+		--numArgs;
+		++args;
+	}
+	else
+	{
+		Usage();
+		return GCMC_USAGE;
+	}
+
+	GCMemcardBatch batch(operation, exportDirectory);
+	for (int i = 0; i < numArgs; ++i)
+	{
+		if (File::IsDirectory(args[i]))
+			batch.AddDirectory(args[i]);
+		else
+			batch.AddCard(args[i]);
+	}
+	batch.Run(numThreads);
+
+	// one line per card: file, result, saves and (for export) saves exported,
+	// followed by the problems that were found
+	const std::vector<GCMemcardBatch::CardResult> &results = batch.GetResults();
+	for (u32 i = 0; i < results.size(); ++i)
+	{
+		const GCMemcardBatch::CardResult &card = results[i];
+		const char *status = (card.repaired && card.result == SUCCESS) ? "repaired" : ResultString(card.result);
+		printf("%s\t%s\t%d", card.fileName.c_str(), status, card.numFiles);
+		if (operation == GCMemcardBatch::BATCH_EXPORT)
+			printf("\t%d", card.numExported);
+		printf("\n");
+		for (u32 j = 0; j < card.problems.size(); ++j)
+			printf("%s: %s\n", card.fileName.c_str(), card.problems[j].c_str());
+	}
+	if (operation == GCMemcardBatch::BATCH_FIXCHECKSUMS)
+		printf("# %d cards, %d repaired, %d failed, %.1f cards/s\n", (int)results.size(), batch.GetNumRepaired(),
+			batch.GetNumFailed(), batch.GetCardsPerSecond());
+	else
+		printf("# %d cards, %d failed, %.1f cards/s\n", (int)results.size(), batch.GetNumFailed(),
+			batch.GetCardsPerSecond());
+
+	return batch.GetNumFailed() ? GCMC_ERROR : GCMC_OK;
+}
+
+static int Archive(const char* operationName, int numArgs, char** args)
+{
+	if (numArgs < 1)
+	{
+		Usage();
+		return GCMC_USAGE;
+	}
+
+	GCMemcardArchive archive(args[0]);
+	if (!archive.IsOpen())
+	{
+		fprintf(stderr, "%s: %s\n", args[0], ResultString(OPENFAIL));
+		return GCMC_ERROR;
+	}
+
+	if (!strcmp(operationName, "add") && numArgs >= 2)
+	{
+		int numFailed = 0;
+		for (int i = 1; i < numArgs; ++i)
+		{
+			// stored under the file name, which keeps the extension
+			std::string name, extension;
+			SplitPath(args[i], NULL, &name, &extension);
+			u32 newBlocks;
+			u32 result = archive.AddCard(args[i], name + extension, newBlocks);
+			if (result != SUCCESS)
+			{
+				fprintf(stderr, "%s: %s\n", args[i], ResultString(result));
+				++numFailed;
+			}
+			else if (!quiet)
+				printf("%s\t%d new blocks\n", (name + extension).c_str(), newBlocks);
+		}
+		if (!quiet)
+			printf("# %d blocks in the archive\n", archive.GetNumBlocks());
+		return numFailed ? GCMC_ERROR : GCMC_OK;
+	}
+	if (!strcmp(operationName, "extract") && numArgs == 3)
+	{
+		u32 result = archive.ExtractCard(args[1], args[2]);
+		if (result != SUCCESS)
+		{
+			fprintf(stderr, "%s: %s\n", args[1], ResultString(result));
+			return GCMC_ERROR;
+		}
+		return GCMC_OK;
+	}
+	if (!strcmp(operationName, "list") && numArgs == 1)
+	{
+		std::vector<std::string> names;
+		archive.GetCardNames(names);
+		for (u32 i = 0; i < names.size(); ++i)
+			printf("%s\n", names[i].c_str());
+		return GCMC_OK;
+	}
+
+	Usage();
+	return GCMC_USAGE;
+}
+
+// the code paths ColorUtil picks from, with the cpu_info flags that select them
+struct BenchVersion
+{
+	const char *name;
+	bool sse2, ssse3, avx2;
+};
+
+static const BenchVersion benchVersions[] =
+{
+	{ "scalar",	false,	false,	false },
+	{ "SSE2",	true,	false,	false },
+	{ "SSSE3",	true,	true,	false },
+	{ "AVX2",	true,	true,	true },
+};
+
+static int Bench(int iterations)
+{
+	const CPUInfo detectedCPU = cpu_info;
+
+	// a banner and an icon frame in both formats, and a palette for the CI8 ones
+	static u16 rgb5a3[96 * 32];
+	static u8 ci8[96 * 32];
+	static u16 palette[256];
+	u32 seed = 1;
+	for (int i = 0; i < 96 * 32; ++i)
+	{
+		seed = seed * 1103515245 + 12345;
+		rgb5a3[i] = (u16)(seed >> 8);
+		ci8[i] = (u8)(seed >> 24);
+		if (i < 256)
+			palette[i] = (u16)(seed >> 16);
+	}
+
+	static u32 decoded[96 * 32], scalar[4][96 * 32];
+	static u32 decodedPalette[256];
+	const char *names[] = { "banner 96x32", "icon 32x32", "palette", "CI8 banner" };
+	const int pixels[] = { 96 * 32, 32 * 32, 256, 96 * 32 };
+
+	printf("%-14s", "");
+	for (u32 t = 0; t < 4; ++t)
+		printf("%16s", names[t]);
+	printf("\n");
+
+	bool identical = true;
+	for (u32 v = 0; v < sizeof(benchVersions) / sizeof(benchVersions[0]); ++v)
+	{
+		const BenchVersion &version = benchVersions[v];
+		printf("%-14s", version.name);
+		if ((version.sse2 && !detectedCPU.bSSE2) || (version.ssse3 && !detectedCPU.bSSSE3) ||
+			(version.avx2 && !detectedCPU.bAVX2))
+		{
+			printf("%16s\n", "not supported");
+			continue;
+		}
+		cpu_info.bSSE2 = version.sse2;
+		cpu_info.bSSSE3 = version.ssse3;
+		cpu_info.bAVX2 = version.avx2;
+
+		for (u32 t = 0; t < 4; ++t)
+		{
+			// the smaller ones run more often, each decodes as many pixels as the banner
+			u32 *dst = t == 2 ? decodedPalette : decoded;
+			const int count = iterations * (96 * 32 / pixels[t]);
+			const u32 start = Common::Timer::GetTimeMs();
+			for (int i = 0; i < count; ++i)
+			{
+				switch (t)
+				{
+				case 0: ColorUtil::decode5A3image(dst, rgb5a3, 96, 32); break;
+				case 1: ColorUtil::decode5A3image(dst, rgb5a3, 32, 32); break;
+				case 2: ColorUtil::decodePalette(dst, palette); break;
+				case 3: ColorUtil::decodeCI8image(dst, ci8, palette, 96, 32); break;
+				}
+			}
+			u32 elapsed = Common::Timer::GetTimeMs() - start;
+			if (!elapsed)
+				elapsed = 1;
+			printf("%11.1f Mpx/s", (double)pixels[t] * count / elapsed / 1000.0);
+
+			// every version has to decode the same pixels as the scalar one
+			if (v == 0)
+				memcpy(scalar[t], dst, pixels[t] * sizeof(u32));
+			else if (memcmp(scalar[t], dst, pixels[t] * sizeof(u32)))
+				identical = false;
+		}
+		printf("\n");
+	}
+
+	cpu_info.bSSE2 = detectedCPU.bSSE2;
+	cpu_info.bSSSE3 = detectedCPU.bSSSE3;
+	cpu_info.bAVX2 = detectedCPU.bAVX2;
+
+	printf("# %d banners worth of pixels each, millions of pixels decoded per second\n", iterations);
+	if (!identical)
+	{
+		fprintf(stderr, "The SIMD versions decoded different pixels than the scalar one\n");
+		return GCMC_ERROR;
+	}
+	return GCMC_OK;
+}
+
+int main(int argc, char** argv)
+{
+	RegisterMsgAlertHandler(&ConsoleMsgAlert);
+
+	int arg = 1;
+	u32 numThreads = 0;
+	while (arg < argc && argv[arg][0] == '-')
+	{
+		if (!strcmp(argv[arg], "-q"))
+		{
+			quiet = true;
+			++arg;
+		}
+		else if (!strcmp(argv[arg], "-j") && arg + 1 < argc && atoi(argv[arg + 1]) > 0)
+		{
+			numThreads = atoi(argv[arg + 1]);
+			arg += 2;
+		}
+		else
+		{
+			Usage();
+			return GCMC_USAGE;
+		}
+	}
+	// the only command without a card
+	if (argc - arg >= 1 && argc - arg <= 2 && !strcmp(argv[arg], "bench"))
+	{
+		const int iterations = argc - arg == 2 ? atoi(argv[arg + 1]) : 20000;
+		if (iterations > 0)
+			return Bench(iterations);
+	}
+	if (argc - arg < 2)
+	{
+		Usage();
+		return GCMC_USAGE;
+	}
+
+	const std::string command = argv[arg];
+	const char* cardName = argv[arg + 1];
+	const int numArgs = argc - arg - 2;
+	char** args = argv + arg + 2;
+
+	if (command == "batch" && numArgs >= 1)
+		return Batch(cardName, numThreads, numArgs, args);
+	if (command == "archive")
+		return Archive(cardName, numArgs, args);
+	if (command == "convert" && numArgs == 1 && !File::IsDirectory(cardName))
+		return Convert(cardName, args[0], NULL);
+	if (command == "convert" && numArgs == 2 && File::IsDirectory(cardName))
+	{
+		if (strcasecmp(args[1], ".gci") && strcasecmp(args[1], ".gcs") && strcasecmp(args[1], ".sav"))
+		{
+			Usage();
+			return GCMC_USAGE;
+		}
+		return Convert(cardName, args[0], args[1]);
+	}
+	if (command == "list" && numArgs == 0)
+		return List(cardName);
+	if (command == "export" && numArgs >= 1)
+		return Export(cardName, args[0], numThreads, numArgs - 1, args + 1);
+	if (command == "import" && numArgs >= 1)
+		return Import(cardName, numArgs, args);
+	if (command == "delete" && numArgs >= 1)
+		return Delete(cardName, numArgs, args);
+	if (command == "copy" && numArgs >= 2)
+		return Copy(cardName, args[0], numArgs - 1, args + 1);
+	if (command == "fsck" && numArgs <= 1)
+	{
+		if (numArgs == 0 || !strcmp(args[0], "--fix"))
+			return Fsck(cardName, numArgs == 1);
+	}
+	if (command == "format" && numArgs <= 2)
+	{
+		u16 sizeMb = MemCard2043Mb;
+		bool sjis = false;
+		for (int i = 0; i < numArgs; ++i)
+		{
+			if (!strcmp(args[i], "--sjis"))
+				sjis = true;
+			else if (!ParseCardSize(args[i], sizeMb))
+				return GCMC_USAGE;
+		}
+		return Format(cardName, sizeMb, sjis);
+	}
+	if (command == "resize" && numArgs == 1)
+	{
+		u16 sizeMb;
+		if (!ParseCardSize(args[0], sizeMb))
+			return GCMC_USAGE;
+		return Resize(cardName, sizeMb);
+	}
+	if (command == "defrag" && numArgs == 0)
+		return Defrag(cardName);
+
+	Usage();
+	return GCMC_USAGE;
+}
@@ -23,6 +23,11 @@ CMemcardManager *main_frame;
 #if defined HAVE_WX && HAVE_WX 
 bool wxMsgAlert(const char* caption, const char* text, bool yes_no, int /*Style*/) 
 {
+	// the cards are loaded on a worker thread, only the GUI thread may
+	// open the message box
+	if (!wxIsMainThread())
+		return main_frame->AlertFromThread(caption, text, yes_no);
+
 	return wxYES == wxMessageBox(wxString::FromAscii(text), 
 				 wxString::FromAscii(caption),
 				 (yes_no)?wxYES_NO:wxOK);
@@ -42,36 +47,3 @@ bool MCMApp::OnInit()
 	SetTopWindow(main_frame);
 	return true;
 }
-namespace CEXIIPL
-{
-u32 GetGCTime()
-{
-	const u32 cJanuary2000 = 0x386D42C0;  // Seconds between 1.1.1970 and 1.1.2000
-	u64 ltime = Common::Timer::GetLocalTimeSinceJan1970();
-	return ((u32)ltime - cJanuary2000);
-}
-};
-
-SRAM g_SRAM = {{
-	0x04, 0x6B,
-	0xFB, 0x91,
-	0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00,
-	0xFF, 0xFF, 0xFF, 0x40,
-	0x05,
-	0x00,
-	0x00,
-	0x2C,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0xD2, 0x2B,	0x29, 0xD5,	0xC7, 0xAA,	0x12, 0xCB,	0x21, 0x27,	0xD1, 0x53,
-	0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00,
-	0x00, 0x00,
-	0x00, 0x00,
-	0x00, 0x00,
-	0x86,
-	0x00,
-	0xFF, 0x4A,
-	0x00, 0x00,
-	0x00, 0x00
-}};
\ No newline at end of file